@@ -2,12 +2,23 @@
 
 #include "ast.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdio>
+#include <map>
+#include <set>
+#include <tuple>
 #include <vector>
 #include <iostream>
 
+#include "literals.h"
+#include "profile.h"
+#include "remarks.h"
+#include "runtime.h"
 #include "util.h"
 
+#include "llvm/Support/raw_ostream.h"
+
 using namespace std;
 
 static LLVMContext* TheContext;
@@ -23,6 +34,35 @@ static int printIndent;
 
 static bool foundExit; // the last translated statm was exit
 
+/* calls of Mila callables in the function being translated, candidates
+ * for tail call elimination */
+static vector<CallInst*> tailCalls;
+
+/* compile time evaluation: variables of the callables being evaluated (the
+ * innermost last) and the callables that may be, by identifier */
+static vector<map<string, int>> evalFrames;
+static map<string, DeclCallable*> evalCallables;
+static unsigned evalSteps; // loop iterations and calls so far
+static const unsigned MAX_EVAL_STEPS = 1000000;
+static const unsigned MAX_EVAL_DEPTH = 1000;
+
+static bool evaluate(Expr * e, int & value);
+static int constValue(Expr * e, const string & what);
+
+/* -fbounds-check: accesses checked in front of the loop being translated
+ * and ranges of the variables of loops with constant bounds */
+static bool boundsCheck;
+static bool boundsReport;
+static set<ArrayElement*> provenAccesses;
+static map<string, pair<int64_t, int64_t>> loopRanges;
+static int currentLine; // of the statement being translated
+
+static bool loopVarInvariant(Statm * body, const string & var);
+static vector<pair<ArrayElement*, int>> hoistableAccesses(Statm * body,
+                                                          const string & var);
+static Value * hoistedCheck(const vector<pair<ArrayElement*, int>> & accesses,
+                            Value * lo, Value * hi);
+
 void ast_init(LLVMContext & context, Module & module, IRBuilder<> & builder,
               SymbolTable & symTab)
 {
@@ -33,11 +73,24 @@ void ast_init(LLVMContext & context, Module & module, IRBuilder<> & builder,
   printIndent = 0;
   foundExit = false;
 
+  runtime_init(context, module);
   WriteLn::declare();
   ReadLn::declare();
   Write::declare();
   Dec::declare();
+  Expect::declare();
   Exit::declare();
+
+  Directives::setConstantLookup([](const string & ident, int & value) {
+    Var v(ident);
+    return evaluate(&v, value);
+  });
+}
+
+void ast_boundsCheck(bool enable, bool report)
+{
+  boundsCheck = enable;
+  boundsReport = enable && report;
 }
 
 Var::Var(std::string a)
@@ -53,6 +106,11 @@ Bop::Bop(Token::Type o, Expr *l, Expr *r)
   :op(o), left(l), right(r)
 {}
 
+Token::Type Bop::getOp() const
+{
+  return op;
+}
+
 UnMinus::UnMinus(Expr *e)
   :expr(e)
 {}
@@ -129,12 +187,23 @@ void Bop::Print()
   printf(")");
 }
 
+void Bop::Children(const function<void (Node *)> &f)
+{
+  f(left.get());
+  f(right.get());
+}
+
 void UnMinus::Print()
 {
 	printf("-");
 	expr->Print();
 }
 
+void UnMinus::Children(const function<void (Node *)> &f)
+{
+  f(expr.get());
+}
+
 void Assign::Print()
 {
   Statm::Print();
@@ -143,11 +212,22 @@ void Assign::Print()
   expr->Print();
 }
 
+void Assign::Children(const function<void (Node *)> &f)
+{
+  f(var.get());
+  f(expr.get());
+}
+
 Var *Assign::getVar()
 {
   return var.get();
 }
 
+Expr *Assign::getExpr()
+{
+  return expr.get();
+}
+
 void StatmList::Print()
 {
    StatmList *s = this;
@@ -158,6 +238,12 @@ void StatmList::Print()
    } while (s);
 }
 
+void StatmList::Children(const function<void (Node *)> &f)
+{
+  for ( StatmList * s = this ; s ; s = s->next.get() )
+    f(s->statm.get());
+}
+
 void StatmList::merge(StatmList *tail, StatmList *root)
 {
   tail->next = unique_ptr<StatmList>(root);
@@ -165,11 +251,6 @@ void StatmList::merge(StatmList *tail, StatmList *root)
 
 Value* Var::Translate() // return dereferenced val
 {
-  if ( expectedConstExpr() ) {
-    symbolTable->ensureConst(name);
-    // todo:
-    error("constant as a constexpr not yet implemented");
-  }
   symbolTable->ensureDeclared(name);
   const SymbolTable::Symbol & s = symbolTable->get(name);
   switch ( s.obj->getType() ) {
@@ -206,8 +287,66 @@ Value* Numb::Translate()
   return ConstantInt::get(*TheContext, APInt(32, value, true));
 }
 
+/* whether the expression may be evaluated even if it does not have to be:
+ * no calls (side effects), no array elements (the index might be the
+ * very thing the other operand checks) and no div or mod (neither might
+ * the divisor) */
+static bool isCheap(Node * n)
+{
+  if ( dynamic_cast<Call*>(n) || dynamic_cast<ArrayElement*>(n) )
+    return false;
+  if ( Bop * b = dynamic_cast<Bop*>(n) )
+    if ( b->getOp() == Token::kwDIV || b->getOp() == Token::kwMOD )
+      return false;
+  if ( Var * v = dynamic_cast<Var*>(n) )
+    if ( symbolTable->exists(v->getName()) &&
+         symbolTable->get(v->getName()).obj->getType() == Object::Callable )
+      return false;
+  bool cheap = true;
+  n->Children([&cheap](Node * child) { cheap = cheap && isCheap(child); });
+  return cheap;
+}
+
+Value *Bop::ShortCircuit()
+{
+  bool isAnd = op == Token::kwAND;
+  Value * l = left->Translate();
+  Constant * shortV = ConstantInt::get(l->getType(), isAnd ? 0 : 1);
+
+  if ( isCheap(right.get()) ) {
+    Value * r = right->Translate();
+    return isAnd ? Builder->CreateSelect(l, r, shortV, "andtmp")
+                 : Builder->CreateSelect(l, shortV, r, "ortmp");
+  }
+
+  /* the right operand is evaluated only if the left one does not decide */
+  Function * f = Builder->GetInsertBlock()->getParent();
+  BasicBlock * lhsBB = Builder->GetInsertBlock();
+  BasicBlock * rhsBB = BasicBlock::Create(*TheContext,
+                                          isAnd ? "andrhs" : "orrhs", f);
+  BasicBlock * mergeBB = BasicBlock::Create(*TheContext,
+                                            isAnd ? "andcont" : "orcont", f);
+  if ( isAnd ) profile_condBr(l, rhsBB, mergeBB);
+  else profile_condBr(l, mergeBB, rhsBB);
+
+  Builder->SetInsertPoint(rhsBB);
+  Value * r = right->Translate();
+  rhsBB = Builder->GetInsertBlock();
+  Builder->CreateBr(mergeBB);
+
+  Builder->SetInsertPoint(mergeBB);
+  PHINode * phi = Builder->CreatePHI(l->getType(), 2,
+                                     isAnd ? "andtmp" : "ortmp");
+  phi->addIncoming(shortV, lhsBB);
+  phi->addIncoming(r, rhsBB);
+  return phi;
+}
+
 Value* Bop::Translate()
 {
+   if ( op == Token::kwAND || op == Token::kwOR )
+     return ShortCircuit();
+
    Value* l = left->Translate();
    Value* r = right->Translate();
    switch (op) {
@@ -233,10 +372,6 @@ Value* Bop::Translate()
      return Builder->CreateICmpSLE(l, r, "ltetmp");
    case Token::GTE:
      return Builder->CreateICmpSGE(l, r, "gtetmp");
-   case Token::kwAND: /* bool op(bool,bool) */
-     return Builder->CreateAnd(l, r, "andtmp");
-   case Token::kwOR:
-     return Builder->CreateOr(l, r, "ortmp");
    default:
      assert ( false );
    }
@@ -265,6 +400,8 @@ Value* StatmList::Translate()
 {
    StatmList *s = this;
    do {
+     remarks_line(s->statm->getLine());
+     if ( s->statm->getLine() ) currentLine = s->statm->getLine();
      s->statm->Translate();
      if ( foundExit ) {
        foundExit = false;
@@ -311,9 +448,26 @@ DeclConst::DeclConst(const string &ident, Expr *expr, Object * o)
 {
 }
 
+DeclConst::DeclConst(const string &ident, const vector<Expr *> &elements,
+                     Object *o)
+  :ident(ident), expr(nullptr), obj(o)
+{
+  for ( Expr * e : elements )
+    this->elements.push_back(unique_ptr<Expr>(e));
+}
+
 Value *DeclConst::Translate()
 {
-  symbolTable->declConst(ident, expr->Translate(), obj);
+  if ( !expr ) { // array, a read-only table the loads can be folded from
+    vector<uint32_t> values;
+    for ( auto & e : elements )
+      values.push_back(constValue(e.get(), "value of " + ident));
+    symbolTable->declConst(ident, ConstantDataArray::get(*TheContext, values),
+                           obj);
+  } else {
+    int value = constValue(expr.get(), "value of " + ident);
+    symbolTable->declConst(ident, Numb(value).Translate(), obj);
+  }
   return Constant::getNullValue(Type::getInt32Ty(*TheContext));
 }
 
@@ -321,10 +475,28 @@ void DeclConst::Print()
 {
   Statm::Print();
   cout << "const";
-  cout << " " << ident << " = "; expr->Print();
+  cout << " " << ident;
+  if ( expr ) {
+    cout << " = "; expr->Print();
+  } else {
+    cout << ": "; obj->Print();
+    cout << " = (";
+    for ( unsigned i = 0 ; i < elements.size() ; ++i ) {
+      if ( i ) cout << ", ";
+      elements[i]->Print();
+    }
+    cout << ")";
+  }
   cout << endl;
 }
 
+void DeclConst::Children(const function<void (Node *)> &f)
+{
+  if ( expr ) f(expr.get());
+  for ( auto & e : elements )
+    f(e.get());
+}
+
 Not::Not(Expr *e)
   :expr(e)
 {
@@ -343,6 +515,11 @@ void Not::Print()
   expr->Print();
 }
 
+void Not::Children(const function<void (Node *)> &f)
+{
+  f(expr.get());
+}
+
 If::If(Expr *a, Statm *b, Statm *c)
   :ifExpr(a), thenStmt(b), elseStmt(c)
 {
@@ -360,7 +537,7 @@ Value *If::Translate()
   BasicBlock * Else;
   Else = BasicBlock::Create(*TheContext, "else", f);
   BasicBlock * Merge = BasicBlock::Create(*TheContext, "ifcont", f);
-  Builder->CreateCondBr(cond, Then, Else);
+  profile_condBr(cond, Then, Else);
 
   /* then */
   Builder->SetInsertPoint(Then);
@@ -403,12 +580,177 @@ void If::Print()
   }
 }
 
+void If::Children(const function<void (Node *)> &f)
+{
+  f(ifExpr.get());
+  f(thenStmt.get());
+  if ( elseStmt ) f(elseStmt.get());
+}
+
+Case::Case(Expr *e)
+  :expr(e)
+{
+}
+
+void Case::addArm(const vector<pair<Expr *, Expr *> > &labels, Statm *stmt)
+{
+  Arm arm;
+  for ( auto & l : labels )
+    arm.labels.push_back(make_pair(unique_ptr<Expr>(l.first),
+                                   unique_ptr<Expr>(l.second)));
+  arm.stmt = unique_ptr<Statm>(stmt);
+  arms.push_back(move(arm));
+}
+
+void Case::setElse(Statm *stmt)
+{
+  elseStmt = unique_ptr<Statm>(stmt);
+}
+
+/* ranges of more values are compared rather than listed in the switch */
+static const int MAX_CASE_RANGE = 256;
+
+static int caseLabel(Expr * e)
+{
+  return constValue(e, "case label");
+}
+
+Value *Case::Translate()
+{
+  Value * v = expr->Translate();
+  assert ( v );
+  Type * ty = v->getType();
+
+  Function * f = Builder->GetInsertBlock()->getParent();
+  BasicBlock * Else = BasicBlock::Create(*TheContext, "caseelse", f);
+  BasicBlock * Merge = BasicBlock::Create(*TheContext, "casecont");
+
+  /* from, to, arm */
+  vector<tuple<int, int, BasicBlock*>> ranges;
+  vector<BasicBlock*> blocks;
+  for ( auto & arm : arms ) {
+    BasicBlock * b = BasicBlock::Create(*TheContext, "case", f, Else);
+    blocks.push_back(b);
+    for ( auto & l : arm.labels ) {
+      int from = caseLabel(l.first.get());
+      int to = l.second ? caseLabel(l.second.get()) : from;
+      if ( from > to ) error("empty case label range");
+      ranges.push_back(make_tuple(from, to, b));
+    }
+  }
+  std::sort(ranges.begin(), ranges.end());
+  for ( unsigned i = 1 ; i < ranges.size() ; ++i )
+    if ( get<0>(ranges[i]) <= get<1>(ranges[i-1]) )
+      error("duplicate case label " + to_string(get<0>(ranges[i])));
+
+  /* the backend lowers the switch to a jump table or a binary search */
+  SwitchInst * sw = Builder->CreateSwitch(v, Else, ranges.size());
+  vector<tuple<int, int, BasicBlock*>> wide;
+  for ( auto & r : ranges ) {
+    if ( (int64_t)get<1>(r) - get<0>(r) >= MAX_CASE_RANGE ) {
+      wide.push_back(r);
+      continue;
+    }
+    for ( int64_t val = get<0>(r) ; val <= get<1>(r) ; ++val )
+      sw->addCase(cast<ConstantInt>(ConstantInt::get(ty, val, true)),
+                  get<2>(r));
+  }
+
+  for ( unsigned i = 0 ; i < arms.size() ; ++i ) {
+    Builder->SetInsertPoint(blocks[i]);
+    Value * armV = arms[i].stmt ? arms[i].stmt->Translate() : Merge;
+    foundExit = false;
+    if ( armV ) // break has yet to be generated
+      Builder->CreateBr(Merge);
+  }
+
+  /* else, after the wide ranges: from <= v <= to as v - from <=u to - from */
+  Builder->SetInsertPoint(Else);
+  for ( auto & r : wide ) {
+    BasicBlock * next = BasicBlock::Create(*TheContext, "caseelse", f);
+    Value * off = Builder->CreateSub(v, ConstantInt::get(ty, get<0>(r), true));
+    Value * in = Builder->CreateICmpULE(
+          off, ConstantInt::get(ty, (int64_t)get<1>(r) - get<0>(r)));
+    Builder->CreateCondBr(in, get<2>(r), next);
+    Builder->SetInsertPoint(next);
+  }
+  Value * elseV = elseStmt ? elseStmt->Translate() : Merge;
+  foundExit = false;
+  if ( elseV ) // break has yet to be generated
+    Builder->CreateBr(Merge);
+
+  f->getBasicBlockList().push_back(Merge);
+  Builder->SetInsertPoint(Merge);
+  return Merge;
+}
+
+void Case::Print()
+{
+  Statm::Print();
+  cout << "case "; expr->Print(); cout << " of\n";
+  printIndent++;
+  for ( auto & arm : arms ) {
+    Statm::Print();
+    bool first = true;
+    for ( auto & l : arm.labels ) {
+      if ( !first ) cout << ", ";
+      first = false;
+      l.first->Print();
+      if ( l.second ) { cout << " .. "; l.second->Print(); }
+    }
+    cout << ":\n";
+    printIndent++;
+    if ( arm.stmt ) arm.stmt->Print();
+    cout << endl;
+    printIndent--;
+  }
+  if ( elseStmt ) {
+    Statm::Print();
+    cout << "else\n";
+    printIndent++;
+    elseStmt->Print();
+    cout << endl;
+    printIndent--;
+  }
+  printIndent--;
+  Statm::Print();
+  cout << "end";
+}
+
+void Case::Children(const function<void (Node *)> &f)
+{
+  f(expr.get());
+  for ( auto & arm : arms ) {
+    for ( auto & l : arm.labels ) {
+      f(l.first.get());
+      if ( l.second ) f(l.second.get());
+    }
+    if ( arm.stmt ) f(arm.stmt.get());
+  }
+  if ( elseStmt ) f(elseStmt.get());
+}
+
+Statm::Statm()
+  :line(0)
+{
+}
+
 void Statm::Print()
 {
   for ( int i = 0 ; i < printIndent ; ++i )
     cout << " ";
 }
 
+void Statm::setLine(int line)
+{
+  this->line = line;
+}
+
+int Statm::getLine() const
+{
+  return line;
+}
+
 While::While()
   :condExpr(nullptr), doStmt(nullptr)
 {
@@ -443,12 +785,12 @@ Value *While::Translate()
 
   condV = Builder->CreateICmpNE(
         condV, ConstantInt::get(*TheContext, APInt(1, 0, true)) , "cond");
-  Builder->CreateCondBr(condV, LoopBB, nextBlock);
+  profile_condBr(condV, LoopBB, nextBlock);
 
   /* loop */
   Builder->SetInsertPoint(LoopBB);
   if ( doStmt->Translate() ) // break has yet to be generated
-    Builder->CreateBr(condBB);
+    directives.apply(Builder->CreateBr(condBB));
 
   /* next */
   Builder->SetInsertPoint(nextBlock);
@@ -466,11 +808,22 @@ void While::Print()
   printIndent--;
 }
 
+void While::Children(const function<void (Node *)> &f)
+{
+  f(condExpr.get());
+  f(doStmt.get());
+}
+
 BasicBlock * Loop::getNextBlock() const
 {
   return nextBlock;
 }
 
+void Loop::setDirectives(const Directives & d)
+{
+  directives = d;
+}
+
 For::For()
   :limitExpr(nullptr), doStmt(nullptr)
 {
@@ -491,46 +844,67 @@ Value *For::Translate()
 
   Function *TheFunction = Builder->GetInsertBlock()->getParent();
 
-  BasicBlock *condBB =
-      BasicBlock::Create(*TheContext, "condblock", TheFunction);
   BasicBlock *LoopBB =
       BasicBlock::Create(*TheContext, "loop", TheFunction);
   nextBlock =
       BasicBlock::Create(*TheContext, "afterloop", TheFunction);
 
-  /* init */
+  /* init, both bounds are evaluated once (Pascal semantics) */
 
   initStmt->Translate();
-  Builder->CreateBr(condBB);
-
-  /* condition */
-  Builder->SetInsertPoint(condBB);
-
+  Var * var = initStmt->getVar();
+  Value * startV = var->Translate();
   Value * limitV = limitExpr->Translate();
   assert ( limitV );
 
-  Var * var = initStmt->getVar();
-
-  Value * condV;
+  /* the body runs |limit - start| + 1 times, if at all */
+  Value * enterV;
   if ( downto )
-    condV = Builder->CreateICmpSGE(var->Translate(), limitV, "gtetmp");
+    enterV = Builder->CreateICmpSGE(startV, limitV, "gtetmp");
   else
-    condV = Builder->CreateICmpSLE(var->Translate(), limitV, "ltetmp");
-
-  Builder->CreateCondBr(condV, LoopBB, nextBlock);
-
-  /* loop */
-  Builder->SetInsertPoint(LoopBB);
-  bool genBreak = doStmt->Translate();
-
-  /* iterate */
-  Numb* one = new Numb(1);
-  Value * updated = Bop( downto ? Token::MINUS : Token::PLUS, new Var(*var), one).Translate();
-  Builder->CreateStore(updated, var->Pointer());
-
-  /* loop end */
-  if ( genBreak ) // break has yet to be generated
-    Builder->CreateBr(condBB);
+    enterV = Builder->CreateICmpSLE(startV, limitV, "ltetmp");
+
+  /* -fbounds-check: with constant bounds the accesses are proven in bounds
+   * where they are translated. otherwise the accesses a[var + c] are
+   * checked once in front of the loop, which then exists twice: without
+   * checks if they pass, with them if they do not */
+  int start = 0, limit = 0;
+  bool invariant = boundsCheck && loopVarInvariant(doStmt.get(),
+                                                   var->getName());
+  bool constBounds = invariant && evaluate(initStmt->getExpr(), start)
+                     && evaluate(limitExpr.get(), limit);
+  vector<pair<ArrayElement*, int>> hoisted;
+  if ( invariant && !constBounds )
+    hoisted = hoistableAccesses(doStmt.get(), var->getName());
+
+  if ( hoisted.empty() ) {
+    BasicBlock * preheader = Builder->GetInsertBlock();
+    Builder->CreateCondBr(enterV, LoopBB, nextBlock);
+
+    auto saved = loopRanges;
+    if ( constBounds )
+      loopRanges[var->getName()] = make_pair(min(start, limit),
+                                             max(start, limit));
+    TranslateLoop(LoopBB, preheader, startV, limitV);
+    loopRanges = saved;
+  } else {
+    BasicBlock * checkBB =
+        BasicBlock::Create(*TheContext, "boundscheck", TheFunction, LoopBB);
+    BasicBlock * checkedBB =
+        BasicBlock::Create(*TheContext, "loopchecked", TheFunction, nextBlock);
+    Builder->CreateCondBr(enterV, checkBB, nextBlock);
+
+    Builder->SetInsertPoint(checkBB);
+    Builder->CreateCondBr(hoistedCheck(hoisted, downto ? limitV : startV,
+                                       downto ? startV : limitV),
+                          LoopBB, checkedBB);
+
+    for ( auto & a : hoisted ) provenAccesses.insert(a.first);
+    TranslateLoop(LoopBB, checkBB, startV, limitV);
+    for ( auto & a : hoisted ) provenAccesses.erase(a.first);
+    foundExit = false;
+    TranslateLoop(checkedBB, checkBB, startV, limitV);
+  }
 
   /* next */
   Builder->SetInsertPoint(nextBlock);
@@ -540,12 +914,53 @@ Value *For::Translate()
 
 }
 
+void For::TranslateLoop(BasicBlock * loopBB, BasicBlock * preheader,
+                        Value * startV, Value * limitV)
+{
+  Function *TheFunction = loopBB->getParent();
+  Var * var = initStmt->getVar();
+
+  /* loop, the induction variable lives in a register, the loop variable
+   * is just a copy of it */
+  Builder->SetInsertPoint(loopBB);
+  PHINode * iv = Builder->CreatePHI(Type::getInt32Ty(*TheContext), 2,
+                                    var->getName());
+  iv->addIncoming(startV, preheader);
+  Builder->CreateStore(iv, var->Pointer());
+  bool genBreak = doStmt->Translate();
+
+  /* iterate, the limit is compared before stepping, so that a limit of
+   * maxint/-maxint does not overflow */
+  if ( genBreak ) { // break has yet to be generated
+    Value * one = ConstantInt::get(*TheContext, APInt(32, 1, true));
+    Value * doneV = Builder->CreateICmpEQ(iv, limitV, "donetmp");
+    Value * updated = downto ? Builder->CreateSub(iv, one, "subtmp")
+                             : Builder->CreateAdd(iv, one, "addtmp");
+    iv->addIncoming(updated, Builder->GetInsertBlock());
+
+    /* the loop variable ends up one past the limit */
+    BasicBlock * exitBB =
+        BasicBlock::Create(*TheContext, "loopexit", TheFunction, nextBlock);
+    directives.apply(profile_condBr(doneV, exitBB, loopBB));
+    Builder->SetInsertPoint(exitBB);
+    Builder->CreateStore(updated, var->Pointer());
+    Builder->CreateBr(nextBlock);
+  }
+}
+
 void For::Print()
 {
   assert ( initStmt && limitExpr && doStmt );
   // todo
 }
 
+void For::Children(const function<void (Node *)> &f)
+{
+  f(initStmt.get());
+  f(limitExpr.get());
+  f(doStmt.get());
+}
+
 Break::Break(const Loop &parent)
   :parent(parent)
 {
@@ -599,11 +1014,26 @@ void Integer::Print()
   cout << "integer";
 }
 
-Value *Array::getElementPtr(Value * arr, Expr *index)
+Value *Array::getElementPtr(Value * arr, Expr *index, bool check)
 {
   Value * v = index->Translate();
   Value * real_idx = Builder->CreateAdd(v, Numb(-mFrom).Translate());
 
+  /* a single unsigned compare covers both bounds */
+  if ( check ) {
+    Function * f = Builder->GetInsertBlock()->getParent();
+    BasicBlock * inBB = BasicBlock::Create(*TheContext, "inbounds", f);
+    BasicBlock * outBB = BasicBlock::Create(*TheContext, "outofbounds", f);
+    Value * size = ConstantInt::get(llvm::Type::getInt32Ty(*TheContext),
+                                    (int64_t)mTo - mFrom + 1);
+    Builder->CreateCondBr(Builder->CreateICmpULT(real_idx, size), inBB, outBB);
+
+    Builder->SetInsertPoint(outBB);
+    Builder->CreateCall(runtime_boundsError(), Numb(currentLine).Translate());
+    Builder->CreateUnreachable();
+    Builder->SetInsertPoint(inBB);
+  }
+
   vector<Value*> indices = {
     /* first index is a pointer offset. this is typically zero */
     ConstantInt::get(llvm::Type::getInt32Ty(*TheContext), 0),
@@ -622,19 +1052,8 @@ Array::Array(Expr *from, Expr *to)
 
 void Array::initLimits()
 {
-  mFromExpr->expectConstExpr(true);
-  mToExpr->expectConstExpr(true);
-  Value * l = mFromExpr->Translate();
-  Value * r = mToExpr->Translate();
-
-  // todo: change to cast<>
-  ConstantInt * lptr = (dyn_cast<ConstantInt>(l));
-  ConstantInt * rptr = (dyn_cast<ConstantInt>(r));
-
-  assert ( lptr && rptr );
-
-  mFrom = lptr->getSExtValue();
-  mTo = rptr->getSExtValue();
+  mFrom = constValue(mFromExpr.get(), "array bound");
+  mTo = constValue(mToExpr.get(), "array bound");
 }
 
 void Array::getLimits(int &from, int &to)
@@ -649,21 +1068,6 @@ void Array::Print()
           ".." << mTo << "] of integer";
 }
 
-bool Expr::expectedConstExpr() const
-{
-  return mExpectedConstExpr;
-}
-
-Expr::Expr()
-  :mExpectedConstExpr(false)
-{
-}
-
-void Expr::expectConstExpr(bool expect)
-{
-  mExpectedConstExpr = expect;
-}
-
 Program::Program(string name)
   :name(name)
 {
@@ -691,11 +1095,14 @@ void DeclCallable::CreateArgSymbols(Function *f)
     Builder->CreateStore(it, s.val);
   }
 }
-DeclCallable::DeclCallable(string ident, StatmList *params, Object *returnType, StatmList *body)
+DeclCallable::DeclCallable(string ident, StatmList *params, Object *returnType, StatmList *body, bool isInline)
   :ident(ident),
     returnType(returnType),
-    body(body)
+    body(body),
+    isInline(isInline),
+    reachable(true)
 {
+  if ( body ) evalCallables[ident] = this;
   unique_ptr<StatmList> ptr(params);
   for ( StatmList * argList = params;
         argList;
@@ -710,6 +1117,8 @@ DeclCallable::DeclCallable(string ident, StatmList *params, Object *returnType,
 
 Value *DeclCallable::Translate()
 {
+  if ( !reachable ) return nullptr;
+
   Type * returnTy;
   if ( returnType ) returnTy = Type::getInt32Ty(*TheContext);
   else returnTy = Type::getVoidTy(*TheContext);
@@ -721,6 +1130,8 @@ Value *DeclCallable::Translate()
     f = (Function*)symbolTable->get(ident).val;
   else
     f = Function::Create(fTy, Function::ExternalLinkage, ident, TheModule);
+  if ( isInline ) f->addFnAttr(Attribute::AlwaysInline);
+  directives.apply(f);
 
   symbolTable->declCallable(!body, ident,
                             new CallableObj(paramIdents.size(),!returnType), f);
@@ -728,9 +1139,12 @@ Value *DeclCallable::Translate()
 
   BasicBlock * b = BasicBlock::Create(*TheContext, "body", f);
   Builder->SetInsertPoint(b);
+  remarks_function(f, ident, getLine());
+  profile_function(f, ident);
 
   string retIdent;
   symbolTable->setLocalScope(f, ident);
+  if ( ident == "main" ) symbolTable->localizeGlobals();
   if ( returnType ) retIdent = CreateReturnSymbol();
   CreateArgSymbols(f);
 
@@ -738,6 +1152,13 @@ Value *DeclCallable::Translate()
   for ( auto & a : f->args() )
     a.setName(paramIdents[idx++]);
 
+  vector<Value*> paramSlots;
+  for ( const string & param : paramIdents )
+    paramSlots.push_back(symbolTable->get(param).val);
+  Value * retSlot = returnType ? symbolTable->get(retIdent).val : nullptr;
+  Instruction * prologueEnd = b->empty() ? nullptr : &b->back();
+
+  tailCalls.clear();
   body->Translate();
 
   BasicBlock * bb = Builder->GetInsertBlock();
@@ -750,10 +1171,140 @@ Value *DeclCallable::Translate()
     symbolTable->setGlobalScope();
   }
 
+  if ( ident != "main" )
+    EliminateTailCalls(f, prologueEnd, paramSlots, retSlot);
+  tailCalls.clear();
+
+  profile_functionEnd();
+  remarks_functionEnd();
   symbolTable->setGlobalScope();
   return nullptr;
 }
 
+DeclCallable::~DeclCallable()
+{
+  auto it = evalCallables.find(ident);
+  if ( it != evalCallables.end() && it->second == this )
+    evalCallables.erase(it);
+}
+
+void DeclCallable::Children(const function<void (Node *)> &f)
+{
+  if ( body ) f(body.get());
+}
+
+/* collects the identifiers the node refers to, a parameterless function
+ * may be called through a plain Var */
+static void collectIdents(Node * n, set<string> & idents)
+{
+  if ( Var * v = dynamic_cast<Var*>(n) ) idents.insert(v->getName());
+  if ( Call * c = dynamic_cast<Call*>(n) ) idents.insert(c->getIdent());
+  n->Children([&idents](Node * child) { collectIdents(child, idents); });
+}
+
+void DeclCallable::markReachable(StatmList *prog)
+{
+  /* a callable may be declared (forward) and then defined */
+  map<string, vector<DeclCallable*>> callables;
+  for ( StatmList * s = prog ; s ; s = s->next.get() )
+    if ( DeclCallable * d = dynamic_cast<DeclCallable*>(s->statm.get()) )
+      callables[d->ident].push_back(d);
+
+  set<string> reached = {"main"};
+  vector<string> worklist = {"main"};
+  while ( !worklist.empty() ) {
+    string ident = worklist.back();
+    worklist.pop_back();
+
+    set<string> idents;
+    for ( DeclCallable * d : callables[ident] )
+      collectIdents(d, idents);
+    for ( const string & callee : idents )
+      if ( callables.count(callee) && reached.insert(callee).second )
+        worklist.push_back(callee);
+  }
+
+  for ( auto & c : callables )
+    if ( !reached.count(c.first) )
+      for ( DeclCallable * d : c.second )
+        d->reachable = false;
+}
+
+/* whether nothing but returning the result follows the call: a store to
+ * the return variable, unconditional branches through empty blocks and
+ * ret of the reloaded return variable (just ret for procedures) */
+static bool isTailCall(CallInst * call, Value * retSlot)
+{
+  Instruction * next = call->getNextNode();
+  if ( retSlot ) {
+    StoreInst * store = dyn_cast_or_null<StoreInst>(next);
+    if ( !store || store->getValueOperand() != call ||
+         store->getPointerOperand() != retSlot )
+      return false;
+    next = store->getNextNode();
+  }
+
+  set<BasicBlock*> visited;
+  while ( BranchInst * br = dyn_cast_or_null<BranchInst>(next) ) {
+    if ( br->isConditional() || !visited.insert(br->getParent()).second )
+      return false;
+    next = &br->getSuccessor(0)->front();
+  }
+
+  if ( retSlot ) {
+    LoadInst * load = dyn_cast_or_null<LoadInst>(next);
+    if ( !load || load->getPointerOperand() != retSlot ) return false;
+    ReturnInst * ret = dyn_cast_or_null<ReturnInst>(load->getNextNode());
+    return ret && ret->getReturnValue() == load;
+  }
+  return next && isa<ReturnInst>(next);
+}
+
+void DeclCallable::EliminateTailCalls(Function *f, Instruction *prologueEnd,
+                                      const vector<Value *> &paramSlots,
+                                      Value *retSlot)
+{
+  BasicBlock * loop = nullptr;
+  for ( CallInst * call : tailCalls ) {
+    if ( !isTailCall(call, retSlot) ) continue;
+    Function * callee = call->getCalledFunction();
+
+    /* self recursion becomes a loop over the body, following the prologue
+     * (allocas, arguments and return variable) */
+    if ( callee == f && !loop ) {
+      BasicBlock & entry = f->getEntryBlock();
+      Instruction * start = prologueEnd ? prologueEnd->getNextNode()
+                                        : &entry.front();
+      while ( isa<AllocaInst>(start) ) start = start->getNextNode();
+      loop = entry.splitBasicBlock(start, "tailrecurse");
+    }
+
+    BasicBlock * bb = call->getParent();
+    while ( &bb->back() != call )
+      bb->back().eraseFromParent();
+    IRBuilder<> builder(bb);
+
+    if ( callee == f ) {
+      for ( unsigned idx = 0 ; idx < paramSlots.size() ; ++idx )
+        builder.CreateStore(call->getArgOperand(idx), paramSlots[idx]);
+      if ( retSlot )
+        builder.CreateStore(Numb(0).Translate(), retSlot);
+      builder.CreateBr(loop);
+      call->eraseFromParent();
+      continue;
+    }
+
+    /* any other callable is returned from right away, the tail call is
+     * guaranteed if the prototypes match */
+    if ( callee->getFunctionType() == f->getFunctionType() )
+      call->setTailCallKind(CallInst::TCK_MustTail);
+    else
+      call->setTailCall();
+    if ( retSlot ) builder.CreateRet(call);
+    else builder.CreateRetVoid();
+  }
+}
+
 std::string DeclCallable::CreateReturnSymbol()
 {
   string ret_ident = ident+"_return";
@@ -762,6 +1313,11 @@ std::string DeclCallable::CreateReturnSymbol()
   return ret_ident;
 }
 
+void DeclCallable::setDirectives(const Directives & d)
+{
+  directives = d;
+}
+
 void DeclCallable::Print()
 {
   Statm::Print();
@@ -780,6 +1336,7 @@ void DeclCallable::Print()
   }
 
   if ( !procedure ) cout << ": integer";
+  if ( isInline ) cout << "; inline";
   if ( body ) {
     cout << "\nbegin\n";
     body->Print();
@@ -836,12 +1393,16 @@ Value *Call::Translate()
   if ( ident == "readln" ) return ReadLn::call((Var*)params.back().get());
   if ( ident == "write" ) return Write::call((String*)params.back().get());
   if ( ident == "dec" ) return Dec::call((Var*)params.back().get());
+  if ( ident == "likely" ) return Expect::call(params.back().get(), true);
+  if ( ident == "unlikely" ) return Expect::call(params.back().get(), false);
   if ( ident == "exit" ) return Exit::call();
 
   std::vector<Value*> args;
   for ( auto & expr : params )
       args.push_back(expr->Translate());
-  return Builder->CreateCall((Function*)s.val, args);
+  CallInst * call = Builder->CreateCall((Function*)s.val, args);
+  tailCalls.push_back(call);
+  return call;
 }
 
 void Call::Print()
@@ -849,98 +1410,42 @@ void Call::Print()
 
 }
 
-Function * WriteLn::f;
-Constant * WriteLn::fmt;
+void Call::Children(const function<void (Node *)> &f)
+{
+  for ( auto & e : params )
+    f(e.get());
+}
+
+const string &Call::getIdent() const
+{
+  return ident;
+}
 
 Value *WriteLn::call(Expr * e)
 {
-  vector<Value*> args = {fmt, e->Translate()};
-  return Builder->CreateCall(f, args);
+  return Builder->CreateCall(runtime_writeln(), e->Translate());
 }
 
 void WriteLn::declare()
 {
-  /* f */
-  vector<Type*> printf_arg_types;
-  printf_arg_types.push_back(Type::getInt8PtrTy(*TheContext));
-
-  FunctionType* printf_type =
-      FunctionType::get(
-        Type::getInt32Ty(*TheContext), printf_arg_types, true);
-
-  f = Function::Create(
-        printf_type, Function::ExternalLinkage,
-        Twine("printf"),
-        TheModule
-        );
-  f->setCallingConv(CallingConv::C);
-
-  /* symbol */
-  symbolTable->declCallable(false, "writeln", new CallableObj(1,false), f);
-
-  /* fmt */
-  Constant *format_const =
-      ConstantDataArray::getString(*TheContext, "%d\n");
-  GlobalVariable * var =
-      new GlobalVariable(
-        *TheModule, ArrayType::get(IntegerType::get(*TheContext, 8), 4),
-        true, GlobalValue::PrivateLinkage, format_const, ".str");
-  Constant *zero =
-      Constant::getNullValue(IntegerType::getInt32Ty(*TheContext));
-  std::vector<Constant*> indices;
-  indices.push_back(zero);
-  indices.push_back(zero);
-  fmt = ConstantExpr::getGetElementPtr(var, indices);
-}
-
-Function * ReadLn::f;
-Constant * ReadLn::fmt;
+  /* the runtime function is emitted once it is used */
+  symbolTable->declCallable(false, "writeln", new CallableObj(1,false), nullptr);
+}
 
 Value *ReadLn::call(Var *v)
 {
-  vector<Value*> args = {fmt, v->Pointer()};
+  Value * ptr = v->Pointer();
   symbolTable->ensureNotConst(v->getName());
   Object::Type type = symbolTable->get(v->getName()).obj->getType();
   if ( type != Object::Integer &&
        type != Object::Array )
     error(v->getName() + " is not assignable");
-  return Builder->CreateCall(f, args);
+  return Builder->CreateCall(runtime_readln(), ptr);
 }
 
 void ReadLn::declare()
 {
-  /* f */
-  vector<Type*> scanf_arg_types;
-  scanf_arg_types.push_back(Type::getInt8PtrTy(*TheContext));
-
-  FunctionType* scanf_type =
-      FunctionType::get(
-        Type::getInt32Ty(*TheContext), scanf_arg_types, true);
-
-  f = Function::Create(
-        scanf_type, Function::ExternalLinkage,
-        Twine("scanf"),
-        TheModule
-        );
-  f->setCallingConv(CallingConv::C);
-
-  /* symbol */
-  symbolTable->declCallable(false, "readln", new CallableObj(1,false), f);
-
-  /* fmt */
-  Constant *format_const =
-      ConstantDataArray::getString(*TheContext, "%d");
-  GlobalVariable *var =
-      new GlobalVariable(
-        *TheModule, ArrayType::get(IntegerType::get(*TheContext, 8), 3),
-        true, GlobalValue::PrivateLinkage, format_const, ".str");
-
-  Constant *zero =
-      Constant::getNullValue(IntegerType::getInt32Ty(*TheContext));
-  std::vector<Constant*> indices;
-  indices.push_back(zero);
-  indices.push_back(zero);
-  fmt = ConstantExpr::getGetElementPtr(var, indices);
+  symbolTable->declCallable(false, "readln", new CallableObj(1,false), nullptr);
 }
 
 String::String(const string &value)
@@ -951,18 +1456,7 @@ String::String(const string &value)
 
 Value *String::Translate()
 {
-  Constant *format_const =
-      ConstantDataArray::getString(*TheContext, value.c_str());
-  GlobalVariable *var =
-      new GlobalVariable(
-        *TheModule, ArrayType::get(IntegerType::get(*TheContext, 8), value.size()+1),
-        true, GlobalValue::PrivateLinkage, format_const, ".str");
-  Constant *zero =
-      Constant::getNullValue(IntegerType::getInt32Ty(*TheContext));
-  std::vector<Constant*> indices;
-  indices.push_back(zero);
-  indices.push_back(zero);
-  return ConstantExpr::getGetElementPtr(var, indices);
+  return literals_get(*TheModule, value);
 }
 
 void String::Print()
@@ -970,32 +1464,20 @@ void String::Print()
   //todo
 }
 
-Constant * Write::fmt;
+unsigned String::size() const
+{
+  return value.size();
+}
 
 Value *Write::call(String *s)
 {
-  vector<Value*> args = {fmt, s->Translate()};
-  return Builder->CreateCall(WriteLn::f, args);
+  vector<Value*> args = {s->Translate(), Numb(s->size()).Translate()};
+  return Builder->CreateCall(runtime_write(), args);
 }
 
 void Write::declare()
 {
-  /* symbol */
-  symbolTable->declCallable(false, "write", new CallableObj(1,true), WriteLn::f);
-
-  /* fmt */
-  Constant *format_const =
-      ConstantDataArray::getString(*TheContext, "%s");
-  GlobalVariable * var =
-      new GlobalVariable(
-        *TheModule, ArrayType::get(IntegerType::get(*TheContext, 8), 3),
-        true, GlobalValue::PrivateLinkage, format_const, ".str");
-  Constant *zero =
-      Constant::getNullValue(IntegerType::getInt32Ty(*TheContext));
-  std::vector<Constant*> indices;
-  indices.push_back(zero);
-  indices.push_back(zero);
-  fmt = ConstantExpr::getGetElementPtr(var, indices);
+  symbolTable->declCallable(false, "write", new CallableObj(1,true), nullptr);
 }
 
 Value *Dec::call(Var *v)
@@ -1011,6 +1493,25 @@ void Dec::declare()
   symbolTable->declCallable(false, "dec", new CallableObj(1,true), nullptr);
 }
 
+Value *Expect::call(Expr * e, bool expected)
+{
+  Value * v = e->Translate();
+  if ( !v->getType()->isIntegerTy(1) )
+    v = Builder->CreateICmpNE(v, ConstantInt::get(v->getType(), 0));
+  Type * i1 = Type::getInt1Ty(*TheContext);
+  Function * expect = Intrinsic::getDeclaration(TheModule, Intrinsic::expect,
+                                                i1);
+  vector<Value*> args = {v, ConstantInt::get(i1, expected)};
+  return Builder->CreateCall(expect, args, expected ? "likely" : "unlikely");
+}
+
+void Expect::declare()
+{
+  /* the branch weights are attached by profile_condBr */
+  symbolTable->declCallable(false, "likely", new CallableObj(1,false), nullptr);
+  symbolTable->declCallable(false, "unlikely", new CallableObj(1,false), nullptr);
+}
+
 Function * Exit::f;
 
 Value *Exit::call()
@@ -1052,11 +1553,483 @@ Value *ArrayElement::Pointer()
     error(ident + " is not an array");
 
   Array * arr = ((Array*)s.obj.get());
-  Value * ret = arr->getElementPtr(s.val, index.get());
+  bool hoisted = boundsCheck && provenAccesses.count(this);
+  bool check = boundsCheck && !hoisted;
+  int64_t lo, hi;
+  int from, to;
+  arr->getLimits(from, to);
+  if ( check && index->Range(lo, hi) && lo >= from && hi <= to )
+    check = false;
+  /* the accesses of a checked loop are reported for both of its copies */
+  if ( boundsReport )
+    errs() << "line " << currentLine << ": " << ident << " "
+           << (hoisted ? "checked in front of the loop"
+                       : check ? "checked" : "in bounds") << "\n";
+  Value * ret = arr->getElementPtr(s.val, index.get(), check);
   return ret;
 }
 
+Expr *ArrayElement::getIndex()
+{
+  return index.get();
+}
+
 void ArrayElement::Print()
 {
   // todo
 }
+
+void ArrayElement::Children(const function<void (Node *)> &f)
+{
+  f(index.get());
+}
+
+/* compile time evaluation
+ *
+ * constant expressions are evaluated on the syntax tree: numbers,
+ * constants, operators and calls of callables whose bodies only touch
+ * their own parameters and local variables. anything else (global
+ * variables, arrays, input/output, too many steps) makes the expression
+ * not constant. arithmetic wraps around at 32 bits like the translated
+ * code does.
+ */
+static bool evaluate(Expr * e, int & value)
+{
+  evalSteps = 0;
+  return e->Evaluate(value);
+}
+
+static int constValue(Expr * e, const string & what)
+{
+  int value;
+  if ( !evaluate(e, value) ) error(what + " is not a constant expression");
+  return value;
+}
+
+static int wrap(int64_t v)
+{
+  return (int32_t)(uint32_t)v;
+}
+
+/* variable of the innermost callable being evaluated, null if none */
+static int * evalVar(const string & ident)
+{
+  if ( evalFrames.empty() ) return nullptr;
+  auto it = evalFrames.back().find(ident);
+  return it == evalFrames.back().end() ? nullptr : &it->second;
+}
+
+/* symbol a name refers to, null if none; the free names of a callable
+ * being evaluated are globals, whatever the caller's locals shadow */
+static const SymbolTable::Symbol * evalSymbol(const string & ident)
+{
+  if ( evalFrames.empty() )
+    return symbolTable->exists(ident) ? &symbolTable->get(ident) : nullptr;
+  if ( !symbolTable->existsGlobal(ident) && !symbolTable->existsForward(ident) )
+    return nullptr;
+  return &symbolTable->getGlobal(ident);
+}
+
+bool Numb::Evaluate(int & value)
+{
+  value = this->value;
+  return true;
+}
+
+bool Var::Evaluate(int & value)
+{
+  if ( int * v = evalVar(name) ) {
+    value = *v;
+    return true;
+  }
+  const SymbolTable::Symbol * sym = evalSymbol(name);
+  if ( !sym ) return false;
+  const SymbolTable::Symbol & s = *sym;
+  if ( s.obj->getType() == Object::Callable )
+    return Call(name, vector<Expr*>()).Evaluate(value);
+  if ( s.type != SymbolTable::Const || s.obj->getType() != Object::Integer )
+    return false;
+  GlobalVariable * gvar = dyn_cast<GlobalVariable>(s.val);
+  ConstantInt * c = gvar ? dyn_cast_or_null<ConstantInt>(gvar->getInitializer())
+                         : nullptr;
+  if ( !c ) return false;
+  value = c->getSExtValue();
+  return true;
+}
+
+/* elements of constant arrays */
+bool ArrayElement::Evaluate(int & value)
+{
+  const SymbolTable::Symbol * sym = evalVar(getName()) ? nullptr
+                                                      : evalSymbol(getName());
+  if ( !sym ) return false;
+  const SymbolTable::Symbol & s = *sym;
+  if ( s.type != SymbolTable::Const || s.obj->getType() != Object::Array )
+    return false;
+
+  int idx, from, to;
+  if ( !index->Evaluate(idx) ) return false;
+  ((Array*)s.obj.get())->getLimits(from, to);
+  if ( idx < from || idx > to ) return false;
+  Constant * table = cast<GlobalVariable>(s.val)->getInitializer();
+  ConstantInt * c = dyn_cast_or_null<ConstantInt>(
+        table->getAggregateElement(idx - from));
+  if ( !c ) return false;
+  value = c->getSExtValue();
+  return true;
+}
+
+bool Bop::Evaluate(int & value)
+{
+  int l, r;
+  if ( !left->Evaluate(l) ) return false;
+  if ( op == Token::kwAND && !l ) { value = 0; return true; }
+  if ( op == Token::kwOR && l ) { value = 1; return true; }
+  if ( !right->Evaluate(r) ) return false;
+
+  switch (op) {
+  case Token::PLUS: value = wrap((int64_t)l + r); break;
+  case Token::MINUS: value = wrap((int64_t)l - r); break;
+  case Token::TIMES: value = wrap((int64_t)l * r); break;
+  case Token::kwDIV:
+  case Token::kwMOD:
+    if ( r == 0 || (l == INT32_MIN && r == -1) ) return false;
+    value = op == Token::kwDIV ? l / r : l % r;
+    break;
+  case Token::EQ: value = l == r; break;
+  case Token::NEQ: value = l != r; break;
+  case Token::LT: value = l < r; break;
+  case Token::GT: value = l > r; break;
+  case Token::LTE: value = l <= r; break;
+  case Token::GTE: value = l >= r; break;
+  case Token::kwAND:
+  case Token::kwOR: value = r != 0; break;
+  default: return false;
+  }
+  return true;
+}
+
+bool UnMinus::Evaluate(int & value)
+{
+  int v;
+  if ( !expr->Evaluate(v) ) return false;
+  value = wrap(-(int64_t)v);
+  return true;
+}
+
+bool Not::Evaluate(int & value)
+{
+  int v;
+  if ( !expr->Evaluate(v) ) return false;
+  value = !v;
+  return true;
+}
+
+bool Call::Evaluate(int & value)
+{
+  if ( ident == "likely" || ident == "unlikely" ) {
+    if ( params.size() != 1 || !params[0]->Evaluate(value) ) return false;
+    value = value != 0;
+    return true;
+  }
+
+  auto it = evalCallables.find(ident);
+  if ( it == evalCallables.end() ) return false;
+  vector<int> args;
+  for ( auto & p : params ) {
+    int a;
+    if ( !p->Evaluate(a) ) return false;
+    args.push_back(a);
+  }
+  return it->second->Evaluate(args, value);
+}
+
+EvalResult Call::Execute()
+{
+  if ( ident == "exit" ) return EvalResult::Exit;
+  if ( ident == "dec" ) {
+    Var * v = params.size() == 1 ? dynamic_cast<Var*>(params[0].get())
+                                 : nullptr;
+    int * slot = v && !dynamic_cast<ArrayElement*>(v) ? evalVar(v->getName())
+                                                      : nullptr;
+    if ( !slot ) return EvalResult::Fail;
+    *slot = wrap((int64_t)*slot - 1);
+    return EvalResult::Next;
+  }
+  int value;
+  return Evaluate(value) ? EvalResult::Next : EvalResult::Fail;
+}
+
+bool DeclCallable::Evaluate(const vector<int> & args, int & result)
+{
+  if ( !body || args.size() != paramIdents.size() ||
+       evalFrames.size() >= MAX_EVAL_DEPTH || ++evalSteps > MAX_EVAL_STEPS )
+    return false;
+
+  map<string, int> frame;
+  for ( unsigned i = 0 ; i < args.size() ; ++i )
+    frame[paramIdents[i]] = args[i];
+  if ( returnType ) frame[ident] = 0;
+
+  evalFrames.push_back(frame);
+  EvalResult r = body->Execute();
+  result = returnType ? evalFrames.back()[ident] : 0;
+  evalFrames.pop_back();
+  return r == EvalResult::Next || r == EvalResult::Exit;
+}
+
+EvalResult Decl::Execute()
+{
+  if ( evalFrames.empty() || obj->getType() != Object::Integer )
+    return EvalResult::Fail;
+  for ( Decl * d = this ; d ; d = d->next.get() )
+    evalFrames.back()[d->ident] = 0;
+  return EvalResult::Next;
+}
+
+EvalResult DeclConst::Execute()
+{
+  int value;
+  if ( evalFrames.empty() || !expr || !expr->Evaluate(value) )
+    return EvalResult::Fail;
+  evalFrames.back()[ident] = value;
+  return EvalResult::Next;
+}
+
+EvalResult Assign::Execute()
+{
+  int value;
+  if ( dynamic_cast<ArrayElement*>(var.get()) || !expr->Evaluate(value) )
+    return EvalResult::Fail;
+  /* looked up after the calls of the expression pushed their frames */
+  int * slot = evalVar(var->getName());
+  if ( !slot ) return EvalResult::Fail;
+  *slot = value;
+  return EvalResult::Next;
+}
+
+EvalResult StatmList::Execute()
+{
+  for ( StatmList * s = this ; s ; s = s->next.get() ) {
+    EvalResult r = s->statm->Execute();
+    if ( r != EvalResult::Next ) return r;
+  }
+  return EvalResult::Next;
+}
+
+EvalResult If::Execute()
+{
+  int cond;
+  if ( !ifExpr->Evaluate(cond) ) return EvalResult::Fail;
+  if ( cond ) return thenStmt->Execute();
+  return elseStmt ? elseStmt->Execute() : EvalResult::Next;
+}
+
+EvalResult Case::Execute()
+{
+  int v;
+  if ( !expr->Evaluate(v) ) return EvalResult::Fail;
+  for ( auto & arm : arms )
+    for ( auto & l : arm.labels ) {
+      int from, to;
+      if ( !l.first->Evaluate(from) ) return EvalResult::Fail;
+      to = from;
+      if ( l.second && !l.second->Evaluate(to) ) return EvalResult::Fail;
+      if ( from <= v && v <= to ) return arm.stmt->Execute();
+    }
+  return elseStmt ? elseStmt->Execute() : EvalResult::Next;
+}
+
+EvalResult While::Execute()
+{
+  for (;;) {
+    int cond;
+    if ( ++evalSteps > MAX_EVAL_STEPS || !condExpr->Evaluate(cond) )
+      return EvalResult::Fail;
+    if ( !cond ) return EvalResult::Next;
+    EvalResult r = doStmt->Execute();
+    if ( r == EvalResult::Break ) return EvalResult::Next;
+    if ( r != EvalResult::Next ) return r;
+  }
+}
+
+/* like the translated loop: the limit is evaluated once and the loop
+ * variable ends up one past it */
+EvalResult For::Execute()
+{
+  int limit;
+  if ( initStmt->Execute() != EvalResult::Next ||
+       !limitExpr->Evaluate(limit) )
+    return EvalResult::Fail;
+  int * slot = evalVar(initStmt->getVar()->getName());
+  int iv = *slot;
+  if ( downto ? iv < limit : iv > limit ) return EvalResult::Next;
+
+  for (;;) {
+    if ( ++evalSteps > MAX_EVAL_STEPS ) return EvalResult::Fail;
+    *evalVar(initStmt->getVar()->getName()) = iv;
+    EvalResult r = doStmt->Execute();
+    if ( r == EvalResult::Break ) return EvalResult::Next;
+    if ( r != EvalResult::Next ) return r;
+    int next = wrap((int64_t)iv + (downto ? -1 : 1));
+    if ( iv == limit ) {
+      *evalVar(initStmt->getVar()->getName()) = next;
+      return EvalResult::Next;
+    }
+    iv = next;
+  }
+}
+
+EvalResult Break::Execute()
+{
+  return EvalResult::Break;
+}
+
+EvalResult Program::Execute()
+{
+  return EvalResult::Next;
+}
+
+/* bounds checks
+ *
+ * Range() is an interval analysis on the syntax tree: constant
+ * expressions, variables of loops with constant bounds, their sums and
+ * differences. accesses whose index range lies within the array bounds
+ * are not checked at all.
+ */
+bool Expr::Range(int64_t & lo, int64_t & hi)
+{
+  int v;
+  if ( !evaluate(this, v) ) return false;
+  lo = hi = v;
+  return true;
+}
+
+bool Var::Range(int64_t & lo, int64_t & hi)
+{
+  auto it = loopRanges.find(name);
+  if ( it == loopRanges.end() ) return Expr::Range(lo, hi);
+  lo = it->second.first;
+  hi = it->second.second;
+  return true;
+}
+
+bool ArrayElement::Range(int64_t & lo, int64_t & hi)
+{
+  return Expr::Range(lo, hi);
+}
+
+/* the translated code wraps around, a range that would is not known */
+static bool fits(int64_t lo, int64_t hi)
+{
+  return lo >= INT32_MIN && hi <= INT32_MAX;
+}
+
+bool Bop::Range(int64_t & lo, int64_t & hi)
+{
+  if ( op != Token::PLUS && op != Token::MINUS ) return Expr::Range(lo, hi);
+  int64_t llo, lhi, rlo, rhi;
+  if ( !left->Range(llo, lhi) || !right->Range(rlo, rhi) ) return false;
+  if ( op == Token::PLUS ) {
+    lo = llo + rlo;
+    hi = lhi + rhi;
+  } else {
+    lo = llo - rhi;
+    hi = lhi - rlo;
+  }
+  return fits(lo, hi);
+}
+
+bool UnMinus::Range(int64_t & lo, int64_t & hi)
+{
+  int64_t l, h;
+  if ( !expr->Range(l, h) ) return false;
+  lo = -h;
+  hi = -l;
+  return fits(lo, hi);
+}
+
+/* the loop variable holds the induction variable in the whole body: the
+ * body does not write it and no callable can (it is not global) */
+static bool loopVarInvariant(Statm * body, const string & var)
+{
+  bool global = !isa<AllocaInst>(symbolTable->get(var).val);
+  bool invariant = true;
+  function<void(Node*)> walk = [&](Node * n) {
+    if ( Assign * a = dynamic_cast<Assign*>(n) )
+      if ( a->getVar()->getName() == var ) invariant = false;
+    if ( Call * c = dynamic_cast<Call*>(n) ) {
+      const string & ident = c->getIdent();
+      if ( ident == "readln" || ident == "dec" )
+        c->Children([&](Node * p) {
+          Var * v = dynamic_cast<Var*>(p);
+          if ( v && v->getName() == var ) invariant = false;
+        });
+      else if ( global && ident != "writeln" && ident != "write"
+                && ident != "likely" && ident != "unlikely" && ident != "exit" )
+        invariant = false;
+    }
+    /* a function without parameters is called without parentheses */
+    Var * v = dynamic_cast<Var*>(n);
+    if ( global && v && symbolTable->exists(v->getName())
+         && symbolTable->get(v->getName()).obj->getType() == Object::Callable )
+      invariant = false;
+    n->Children(walk);
+  };
+  walk(body);
+  return invariant;
+}
+
+/* accesses a[var + c] of the body with the offsets c, none if the body
+ * contains another loop (it would be translated twice for each copy) */
+static vector<pair<ArrayElement*, int>> hoistableAccesses(Statm * body,
+                                                          const string & var)
+{
+  vector<pair<ArrayElement*, int>> accesses;
+  bool nested = false;
+  auto saved = loopRanges;
+  function<void(Node*)> walk = [&](Node * n) {
+    if ( dynamic_cast<Loop*>(n) ) nested = true;
+    ArrayElement * e = dynamic_cast<ArrayElement*>(n);
+    if ( e && symbolTable->exists(e->getName())
+         && symbolTable->get(e->getName()).obj->getType() == Object::Array ) {
+      /* the index is var + c if it grows by one with var */
+      int64_t lo0, hi0, lo1, hi1;
+      loopRanges[var] = make_pair(0, 0);
+      bool at0 = e->getIndex()->Range(lo0, hi0);
+      loopRanges[var] = make_pair(1, 1);
+      bool at1 = e->getIndex()->Range(lo1, hi1);
+      if ( at0 && at1 && lo0 == hi0 && lo1 == hi1 && lo1 == lo0 + 1 )
+        accesses.push_back(make_pair(e, (int)lo0));
+    }
+    n->Children(walk);
+  };
+  walk(body);
+  loopRanges = saved;
+  if ( nested ) accesses.clear();
+  return accesses;
+}
+
+/* all the accesses are in bounds for var from lo to hi, computed at 64
+ * bits so that var + c does not wrap around */
+static Value * hoistedCheck(const vector<pair<ArrayElement*, int>> & accesses,
+                            Value * lo, Value * hi)
+{
+  Type * i64 = Type::getInt64Ty(*TheContext);
+  lo = Builder->CreateSExt(lo, i64);
+  hi = Builder->CreateSExt(hi, i64);
+  Value * inBounds = ConstantInt::getTrue(*TheContext);
+  for ( auto & a : accesses ) {
+    int from, to;
+    const SymbolTable::Symbol & s = symbolTable->get(a.first->getName());
+    ((Array*)s.obj.get())->getLimits(from, to);
+    Value * c = ConstantInt::get(i64, a.second, true);
+    Value * first = Builder->CreateAdd(lo, c);
+    Value * last = Builder->CreateAdd(hi, c);
+    inBounds = Builder->CreateAnd(inBounds, Builder->CreateICmpSGE(
+                                    first, ConstantInt::get(i64, from, true)));
+    inBounds = Builder->CreateAnd(inBounds, Builder->CreateICmpSLE(
+                                    last, ConstantInt::get(i64, to, true)));
+  }
+  return inBounds;
+}
@@ -3,6 +3,8 @@
 #ifndef _TREE_
 #define _TREE_
 
+#include <cstdint>
+#include <functional>
 #include <string>
 
 #include "llvm/ADT/APInt.h"
@@ -12,6 +14,7 @@
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
@@ -19,6 +22,7 @@
 
 #include "llvm/IR/CFG.h" // pred_begin
 
+#include "directives.h"
 #include "symtab.h"
 #include "lexer.h"
 
@@ -27,29 +31,45 @@ using namespace llvm;
 void ast_init(LLVMContext & context, Module & module, IRBuilder<> & builder,
               SymbolTable & symTab);
 
+/* -fbounds-check: array accesses not proven to be in bounds are checked,
+ * report prints how each access was translated */
+void ast_boundsCheck(bool enable, bool report);
+
 class Object;
 class StatmList;
 
+/* how the compile time execution of a statement ended */
+enum class EvalResult { Next, Break, Exit, Fail };
+
 class Node {
 public:
    virtual Value* Translate() = 0; // if returns nullptr -> break
    virtual void Print() = 0;
+   virtual void Children(const function<void(Node*)> & f) {} // direct children
    virtual ~Node() {}
 };
 
 class Expr : public Node {
-private:
-  bool mExpectedConstExpr;
-protected:
-  bool expectedConstExpr() const;
 public:
-  Expr();
-  void expectConstExpr(bool expect);
+  /* compile time evaluation of constant expressions, calls of callables
+   * without side effects included. false if the value is not known */
+  virtual bool Evaluate(int & value) { return false; }
+
+  /* interval of the values the expression can have at run time, within
+   * the loops being translated. false if not known */
+  virtual bool Range(int64_t & lo, int64_t & hi);
 };
 
 class Statm : public Node {
+   int line; // where the statement starts, 0 if unknown
 public:
+   Statm();
    virtual void Print(); // block indent
+   void setLine(int line);
+   int getLine() const;
+
+   /* compile time execution, within a callable being evaluated */
+   virtual EvalResult Execute() { return EvalResult::Fail; }
 };
 
 class Var : public Expr {
@@ -58,6 +78,8 @@ public:
    Var(std::string name);
    virtual Value* Translate();
    virtual void Print();
+   virtual bool Evaluate(int & value);
+   virtual bool Range(int64_t & lo, int64_t & hi);
 
    virtual Value * Pointer();
    const SymbolTable::Symbol &Symbol();
@@ -70,6 +92,7 @@ public:
    Numb(int);
    virtual Value* Translate();
    virtual void Print();
+   virtual bool Evaluate(int & value);
    int NumbValue();
 };
 
@@ -79,15 +102,22 @@ public:
   String(const string & value);
   virtual Value * Translate();
   virtual void Print();
+  unsigned size() const;
 };
 
 class Bop : public Expr {
    Token::Type op;
    unique_ptr<Expr> left, right;
+
+   Value * ShortCircuit(); // and, or
 public:
    Bop(Token::Type, Expr*, Expr*);
+   Token::Type getOp() const;
    virtual Value* Translate();
    virtual void Print();
+   virtual bool Evaluate(int & value);
+   virtual bool Range(int64_t & lo, int64_t & hi);
+   virtual void Children(const function<void(Node*)> & f);
 };
 
 class UnMinus : public Expr {
@@ -96,6 +126,9 @@ public:
    UnMinus(Expr *e);
    virtual Value* Translate();
    virtual void Print();
+   virtual bool Evaluate(int & value);
+   virtual bool Range(int64_t & lo, int64_t & hi);
+   virtual void Children(const function<void(Node*)> & f);
 };
 
 class Not : public Expr {
@@ -104,6 +137,8 @@ public:
    Not(Expr *e);
    virtual Value* Translate();
    virtual void Print();
+   virtual bool Evaluate(int & value);
+   virtual void Children(const function<void(Node*)> & f);
 };
 
 class Decl: public Statm {
@@ -114,6 +149,7 @@ public:
   Decl(const string & ident, Decl * n, Object * o = 0);
   virtual Value* Translate();
   virtual void Print();
+  virtual EvalResult Execute();
 
   friend class DeclCallable;
 };
@@ -121,11 +157,15 @@ public:
 class DeclConst: public Statm {
   string ident;
   unique_ptr<Expr> expr;
+  vector<unique_ptr<Expr>> elements; // of an array constant
   Object * obj;
 public:
    DeclConst(const string & ident, Expr * expr, Object * o);
+   DeclConst(const string & ident, const vector<Expr*> & elements, Object * o);
    virtual Value* Translate();
    virtual void Print();
+   virtual EvalResult Execute();
+   virtual void Children(const function<void(Node*)> & f);
 };
 
 class DeclCallable: public Statm {
@@ -136,16 +176,35 @@ class DeclCallable: public Statm {
 
   unique_ptr<Object> returnType;
   unique_ptr<StatmList> body;
+  bool isInline;
+  bool reachable;
+  Directives directives;
 private:
   std::string CreateReturnSymbol();
   void CreateArgSymbols(Function * f);
+  /* self recursive tail calls become loops, other tail calls ret right
+   * after the call */
+  void EliminateTailCalls(Function * f, Instruction * prologueEnd,
+                          const vector<Value*> & paramSlots, Value * retSlot);
 public:
   DeclCallable(string ident, StatmList * params,
                Object * returnType, /* null ? procedure : function */
-               StatmList * body /* null ? declaration : definition */
+               StatmList * body, /* null ? declaration : definition */
+               bool isInline = false
                );
+  virtual ~DeclCallable();
   virtual Value* Translate();
   virtual void Print();
+  virtual void Children(const function<void(Node*)> & f);
+
+  void setDirectives(const Directives & d);
+
+  /* callables main cannot reach are not translated at all */
+  static void markReachable(StatmList * prog);
+
+  /* runs the body at compile time, false if it has side effects (or is
+   * not supported by the evaluator) */
+  bool Evaluate(const vector<int> & args, int & result);
 };
 
 class Call: public Statm, public Expr { // multiple inheritance, phhhh :/
@@ -156,6 +215,10 @@ public:
 
    virtual Value* Translate();
    virtual void Print();
+   virtual void Children(const function<void(Node*)> & f);
+   virtual bool Evaluate(int & value);
+   virtual EvalResult Execute();
+   const string & getIdent() const;
 };
 
 class Assign : public Statm {
@@ -165,7 +228,10 @@ public:
    Assign(Var*, Expr*);
    virtual Value* Translate();
    virtual void Print();
+   virtual void Children(const function<void(Node*)> & f);
+   virtual EvalResult Execute();
    Var * getVar();
+   Expr * getExpr();
 };
 
 class ArrayElement : public Var {
@@ -177,6 +243,10 @@ public:
   virtual Value * Pointer();
 
   virtual void Print();
+  virtual void Children(const function<void(Node*)> & f);
+  virtual bool Evaluate(int & value);
+  virtual bool Range(int64_t & lo, int64_t & hi);
+  Expr * getIndex();
 };
 
 class StatmList : public Statm {
@@ -186,6 +256,8 @@ public:
   StatmList(Statm*, StatmList*);
   virtual  Value* Translate();
   virtual void Print();
+  virtual void Children(const function<void(Node*)> & f);
+  virtual EvalResult Execute();
 
   static void merge(StatmList * tailA, StatmList * rootB);
   friend class DeclCallable;
@@ -199,15 +271,39 @@ public:
   If(Expr*,Statm*,Statm*);
   virtual Value* Translate();
   virtual void Print();
+  virtual void Children(const function<void(Node*)> & f);
+  virtual EvalResult Execute();
+};
+
+class Case: public Statm {
+  struct Arm {
+    vector<pair<unique_ptr<Expr>, unique_ptr<Expr>>> labels; // from .. to
+    unique_ptr<Statm> stmt;
+  };
+  unique_ptr<Expr> expr;
+  vector<Arm> arms;
+  unique_ptr<Statm> elseStmt;
+public:
+  Case(Expr * expr);
+  /* label to is null if the label is a single value */
+  void addArm(const vector<pair<Expr*, Expr*>> & labels, Statm * stmt);
+  void setElse(Statm * stmt);
+
+  virtual Value* Translate();
+  virtual void Print();
+  virtual void Children(const function<void(Node*)> & f);
+  virtual EvalResult Execute();
 };
 
 class Loop : public Statm {
 protected:
   BasicBlock * nextBlock;
+  Directives directives; // applied to the backedge
 public:
   virtual Value* Translate() = 0;
   virtual void Print() = 0;
   BasicBlock * getNextBlock() const;
+  void setDirectives(const Directives & d);
 };
 
 class While: public Loop {
@@ -219,6 +315,8 @@ public:
 
   virtual Value* Translate();
   virtual void Print();
+  virtual void Children(const function<void(Node*)> & f);
+  virtual EvalResult Execute();
 };
 
 class For: public Loop {
@@ -226,6 +324,10 @@ class For: public Loop {
   unique_ptr<Assign> initStmt;
   unique_ptr<Expr> limitExpr;
   unique_ptr<Statm> doStmt;
+
+  /* the loop from the header on, entered from preheader */
+  void TranslateLoop(BasicBlock * loopBB, BasicBlock * preheader,
+                     Value * startV, Value * limitV);
 public:
   For();
   void init(Assign * initStatm, bool downto,
@@ -233,6 +335,8 @@ public:
 
   virtual Value* Translate();
   virtual void Print();
+  virtual void Children(const function<void(Node*)> & f);
+  virtual EvalResult Execute();
 };
 
 class Break: public Statm {
@@ -241,6 +345,7 @@ public:
   Break(const Loop & parent);
   virtual Value* Translate();
   virtual void Print();
+  virtual EvalResult Execute();
 };
 
 class Program: public Statm {
@@ -249,32 +354,24 @@ public:
   Program(string name);
   virtual Value* Translate();
   virtual void Print();
+  virtual EvalResult Execute();
 };
 
 /* pre-defined functions */
 
 class WriteLn : public Statm {
-private:
-  friend class Write;
-  static Function * f;
-  static Constant * fmt;
 public:
   static Value * call(Expr * e);
   static void declare();
 };
 
 class ReadLn : public Statm {
-private:
-  static Function * f;
-  static Constant * fmt;
 public:
   static Value * call(Var *v);
   static void declare();
 };
 
 class Write : public Statm {
-private:
-  static Constant * fmt;
 public:
   static Value * call(String *s);
   static void declare();
@@ -286,6 +383,12 @@ public:
   static void declare();
 };
 
+class Expect : public Statm { // likely(e), unlikely(e): branch hints
+public:
+  static Value * call(Expr * e, bool expected);
+  static void declare();
+};
+
 class Exit : public Statm {
 private:
   static Function * f;
@@ -323,7 +426,8 @@ private:
   int mFrom;
   int mTo;
 public:
-  Value * getElementPtr(Value *arr, Expr * index);
+  /* check: the index is compared with the bounds at run time */
+  Value * getElementPtr(Value *arr, Expr * index, bool check = false);
 public:
   Array(Expr * from, Expr * to);
 
@@ -0,0 +1,108 @@
+#include "attributes.h"
+
+#include <map>
+
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Operator.h"
+
+using namespace std;
+
+/* ordered, the effect of a function is the maximum of its instructions */
+enum Effect { NoEffect, ReadsMemory, WritesMemory };
+
+/* memory in the stack frame of the function itself is not observable */
+static bool isLocal(Value * ptr)
+{
+  while ( true ) {
+    ptr = ptr->stripPointerCasts();
+    if ( GEPOperator * gep = dyn_cast<GEPOperator>(ptr) )
+      ptr = gep->getPointerOperand();
+    else
+      return isa<AllocaInst>(ptr);
+  }
+}
+
+static bool isConstantGlobal(Value * ptr)
+{
+  while ( true ) {
+    ptr = ptr->stripPointerCasts();
+    if ( GEPOperator * gep = dyn_cast<GEPOperator>(ptr) )
+      ptr = gep->getPointerOperand();
+    else {
+      GlobalVariable * gvar = dyn_cast<GlobalVariable>(ptr);
+      return gvar && gvar->isConstant();
+    }
+  }
+}
+
+static Effect calleeEffect(Function * f, const map<Function*, Effect> & effects)
+{
+  if ( !f ) return WritesMemory; // indirect call
+  auto it = effects.find(f);
+  if ( it != effects.end() ) return it->second;
+  if ( f->doesNotAccessMemory() ) return NoEffect;
+  if ( f->onlyReadsMemory() ) return ReadsMemory;
+  return WritesMemory;
+}
+
+static Effect instructionEffect(Instruction & I,
+                                const map<Function*, Effect> & effects)
+{
+  if ( StoreInst * store = dyn_cast<StoreInst>(&I) )
+    return isLocal(store->getPointerOperand()) ? NoEffect : WritesMemory;
+  if ( LoadInst * load = dyn_cast<LoadInst>(&I) ) {
+    Value * ptr = load->getPointerOperand();
+    return isLocal(ptr) || isConstantGlobal(ptr) ? NoEffect : ReadsMemory;
+  }
+  if ( CallInst * call = dyn_cast<CallInst>(&I) ) {
+    if ( isa<DbgInfoIntrinsic>(call) ) return NoEffect;
+    return calleeEffect(call->getCalledFunction(), effects);
+  }
+  if ( I.mayWriteToMemory() ) return WritesMemory;
+  if ( I.mayReadFromMemory() ) return ReadsMemory;
+  return NoEffect;
+}
+
+void attributes_infer(Module & module, bool internalize)
+{
+  /* optimistic start, the effects only grow until nothing changes, so
+   * that (mutually) recursive functions are handled as well */
+  map<Function*, Effect> effects;
+  for ( Function & f : module )
+    if ( !f.isDeclaration() ) effects[&f] = NoEffect;
+
+  bool changed = true;
+  while ( changed ) {
+    changed = false;
+    for ( auto & it : effects ) {
+      Effect e = it.second;
+      for ( BasicBlock & bb : *it.first ) {
+        for ( Instruction & I : bb ) {
+          e = max(e, instructionEffect(I, effects));
+          if ( e == WritesMemory ) break;
+        }
+        if ( e == WritesMemory ) break;
+      }
+      if ( e != it.second ) {
+        it.second = e;
+        changed = true;
+      }
+    }
+  }
+
+  for ( Function & f : module ) {
+    /* no exceptions, neither in Mila nor in the C library */
+    f.addFnAttr(Attribute::NoUnwind);
+    if ( f.isDeclaration() ) continue;
+
+    if ( internalize && f.getName() != "main" )
+      f.setLinkage(GlobalValue::InternalLinkage);
+
+    switch ( effects[&f] ) {
+    case NoEffect: f.addFnAttr(Attribute::ReadNone); break;
+    case ReadsMemory: f.addFnAttr(Attribute::ReadOnly); break;
+    case WritesMemory: break;
+    }
+  }
+}
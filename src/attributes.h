@@ -0,0 +1,18 @@
+#ifndef ATTRIBUTES_H
+#define ATTRIBUTES_H
+
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+
+/* interprocedural function attribute inference
+ *
+ * Mila has no exceptions, so every function is nounwind. functions that do
+ * not touch memory outside of their own stack frame (transitively through
+ * the functions they call) are readnone, those that only read it readonly.
+ * everything except main gets internal linkage, unless the module is only
+ * a part of the program (-fstream).
+ */
+void attributes_infer(Module & module, bool internalize = true);
+
+#endif // ATTRIBUTES_H
@@ -0,0 +1,207 @@
+#include "cache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/TimeValue.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static const size_t KEY_LEN = 32; // md5 in hex
+
+static bool mEnabled = false;
+static string mDir;
+static uint64_t mMaxSize;
+static MD5 mHash;
+static string mKey; // once the hash is final
+
+void cache_init(const string & dir, uint64_t maxSize)
+{
+  mDir = dir;
+  mMaxSize = maxSize;
+  mEnabled = !sys::fs::create_directories(mDir);
+  if ( !mEnabled )
+    errs() << "warning: cannot create the cache directory " << mDir
+           << ", not caching\n";
+}
+
+void cache_key(const string & data)
+{
+  /* the length keeps "ab" "c" and "a" "bc" apart */
+  mHash.update(to_string(data.size()) + ":");
+  mHash.update(data);
+}
+
+bool cache_keyFile(const string & file)
+{
+  ErrorOr<unique_ptr<MemoryBuffer>> buf = MemoryBuffer::getFile(file, -1,
+                                                                false);
+  if ( !buf ) return false;
+  cache_key((*buf)->getBuffer());
+  return true;
+}
+
+static const string & key()
+{
+  if ( mKey.empty() ) {
+    MD5::MD5Result result;
+    mHash.final(result);
+    SmallString<32> hex;
+    MD5::stringifyResult(result, hex);
+    mKey = hex.str();
+  }
+  return mKey;
+}
+
+static string entryPath(const string & name)
+{
+  SmallString<128> path(mDir);
+  sys::path::append(path, name);
+  return path.str();
+}
+
+/* written to a unique file first and renamed, so that neither concurrent
+ * compiles nor a running program see a half written file */
+static bool copyFile(const string & from, const string & to)
+{
+  sys::fs::file_status st;
+  if ( sys::fs::status(from, st) ) return false;
+  ErrorOr<unique_ptr<MemoryBuffer>> buf = MemoryBuffer::getFile(from, -1,
+                                                                false);
+  if ( !buf ) return false;
+
+  SmallString<128> tmp;
+  int fd;
+  if ( sys::fs::createUniqueFile(to + "-%%%%%%%%", fd, tmp,
+                                 st.permissions()) )
+    return false;
+  bool ok;
+  {
+    raw_fd_ostream out(fd, true);
+    out << (*buf)->getBuffer();
+    out.close();
+    ok = !out.has_error();
+    out.clear_error();
+  }
+  if ( ok && !sys::fs::rename(tmp.str(), to) ) return true;
+  sys::fs::remove(tmp.str());
+  return false;
+}
+
+/* hits and misses */
+
+static void readStats(uint64_t & hits, uint64_t & misses)
+{
+  hits = misses = 0;
+  ifstream in(entryPath("stats"));
+  string name;
+  uint64_t value;
+  while ( in >> name >> value ) {
+    if ( name == "hits" ) hits = value;
+    if ( name == "misses" ) misses = value;
+  }
+}
+
+/* concurrent compiles may lose a count now and then */
+static void countLookup(bool hit)
+{
+  uint64_t hits, misses;
+  readStats(hits, misses);
+  (hit ? hits : misses)++;
+
+  SmallString<128> tmp;
+  int fd;
+  if ( sys::fs::createUniqueFile(entryPath("stats-%%%%%%%%"), fd, tmp) )
+    return;
+  {
+    raw_fd_ostream out(fd, true);
+    out << "hits " << hits << "\nmisses " << misses << "\n";
+    out.close();
+    out.clear_error();
+  }
+  if ( sys::fs::rename(tmp.str(), entryPath("stats")) )
+    sys::fs::remove(tmp.str());
+}
+
+/* a hit makes the entry the most recently used one */
+static void touch(const string & path)
+{
+  int fd;
+  if ( sys::fs::openFileForWrite(path, fd, sys::fs::F_Append) ) return;
+  sys::fs::setLastModificationAndAccessTime(fd, sys::TimeValue::now());
+  close(fd);
+}
+
+bool cache_fetch(const string & output)
+{
+  if ( !mEnabled ) return false;
+  string entry = entryPath(key());
+  bool hit = sys::fs::exists(entry) && copyFile(entry, output);
+  if ( hit ) touch(entry);
+  countLookup(hit);
+  return hit;
+}
+
+/* entries by last use, the oldest go first */
+static void evict()
+{
+  vector<tuple<sys::TimeValue, uint64_t, string>> entries;
+  uint64_t total = 0;
+  std::error_code EC;
+  for ( sys::fs::directory_iterator it(mDir, EC), end ; it != end && !EC ;
+        it.increment(EC) ) {
+    if ( sys::path::filename(it->path()).size() != KEY_LEN ) continue;
+    sys::fs::file_status st;
+    if ( it->status(st) ) continue;
+    entries.push_back(make_tuple(st.getLastModificationTime(), st.getSize(),
+                                 it->path()));
+    total += st.getSize();
+  }
+
+  sort(entries.begin(), entries.end());
+  for ( auto & e : entries ) {
+    if ( total <= mMaxSize ) break;
+    if ( !sys::fs::remove(get<2>(e)) ) total -= get<1>(e);
+  }
+}
+
+void cache_store(const string & output)
+{
+  if ( !mEnabled ) return;
+  if ( copyFile(output, entryPath(key())) ) evict();
+}
+
+void cache_printStats()
+{
+  if ( !mEnabled ) return;
+  uint64_t hits, misses;
+  readStats(hits, misses);
+
+  uint64_t entries = 0, size = 0;
+  std::error_code EC;
+  for ( sys::fs::directory_iterator it(mDir, EC), end ; it != end && !EC ;
+        it.increment(EC) ) {
+    sys::fs::file_status st;
+    if ( sys::path::filename(it->path()).size() != KEY_LEN || it->status(st) )
+      continue;
+    entries++;
+    size += st.getSize();
+  }
+
+  uint64_t lookups = hits + misses;
+  errs() << "cache " << mDir << ": " << hits << " hits, " << misses
+         << " misses";
+  if ( lookups )
+    errs() << " (" << hits * 100 / lookups << "% hit rate)";
+  errs() << ", " << entries << " entries, " << size / 1024 << " of "
+         << mMaxSize / 1024 << " KiB\n";
+}
@@ -0,0 +1,31 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+/* compile cache
+ *
+ * outputs (executables, objects, ...) are kept in a directory under the
+ * hash of everything they depend on: the program, the compiler binary,
+ * the target and the options. a compile whose key is found just copies the
+ * output. the least recently used outputs are removed once the directory
+ * grows over its size limit. hits and misses are counted in the directory.
+ *
+ * nothing is done unless cache_init was called.
+ */
+void cache_init(const string & dir, uint64_t maxSize);
+
+void cache_key(const string & data); // adds data to the key
+bool cache_keyFile(const string & file); // adds the contents of file
+
+/* copies the cached output for the key to output, false on a miss */
+bool cache_fetch(const string & output);
+/* stores output under the key */
+void cache_store(const string & output);
+
+void cache_printStats();
+
+#endif // CACHE_H
@@ -0,0 +1,135 @@
+#include "directives.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Metadata.h"
+
+#include "util.h"
+
+static const char * OPT_LEVEL_ATTR = "mila-opt-level";
+
+static function<bool(const string &, int &)> mConstantLookup;
+
+Directives::Directives()
+  : mOptLevel(-1),
+    mHot(false),
+    mCold(false),
+    mNoInline(false)
+{
+}
+
+static string lower(string s)
+{
+  transform(s.begin(), s.end(), s.begin(), ::tolower);
+  return s;
+}
+
+/* positive count of a directive, -1 if it is not one */
+int Directives::count(const string & name, const string & arg) const
+{
+  int n = 0;
+  if ( isdigit(arg[0]) ) n = atoi(arg.c_str());
+  else if ( mConstantLookup && !mConstantLookup(arg, n) ) n = 0;
+  if ( n <= 0 ) {
+    warning("invalid directive {$" + name + " " + arg + "}, ignoring it");
+    return -1;
+  }
+  return n;
+}
+
+void Directives::parse(const string & text)
+{
+  string name, arg;
+  istringstream(text) >> name >> arg;
+  name = lower(name);
+  if ( (name == "unroll" || name == "vectorize") && arg.empty() ) {
+    warning("directive {$" + text + "} needs a value, ignoring it");
+    return;
+  }
+
+  if ( name.size() == 2 && name[0] == 'o' && name[1] >= '0' && name[1] <= '3' )
+    mOptLevel = name[1] - '0';
+  else if ( name == "hot" ) mHot = true;
+  else if ( name == "cold" ) mCold = true;
+  else if ( name == "noinline" ) mNoInline = true;
+  else if ( name == "unroll" ) mUnroll = arg;
+  else if ( name == "vectorize" ) mVectorize = arg;
+  else warning("unknown directive {$" + text + "}, ignoring it");
+}
+
+void Directives::apply(Function * f) const
+{
+  if ( mOptLevel == 0 ) {
+    f->removeFnAttr(Attribute::AlwaysInline);
+    f->addFnAttr(Attribute::OptimizeNone);
+    f->addFnAttr(Attribute::NoInline);
+  } else if ( mOptLevel > 0 )
+    f->addFnAttr(OPT_LEVEL_ATTR, to_string(mOptLevel));
+
+  if ( mHot ) f->addFnAttr(Attribute::InlineHint);
+  if ( mCold ) f->addFnAttr(Attribute::Cold);
+  if ( mNoInline ) {
+    f->removeFnAttr(Attribute::AlwaysInline);
+    f->addFnAttr(Attribute::NoInline);
+  }
+}
+
+static MDNode * loopHint(LLVMContext & context, const char * name,
+                         Constant * value = nullptr)
+{
+  vector<Metadata*> ops = {MDString::get(context, name)};
+  if ( value ) ops.push_back(ConstantAsMetadata::get(value));
+  return MDNode::get(context, ops);
+}
+
+void Directives::apply(BranchInst * latch) const
+{
+  LLVMContext & context = latch->getContext();
+  Type * i32 = Type::getInt32Ty(context);
+
+  int unroll = -1;    // not set, 0: off
+  int vectorize = -1; // not set, 0: off, 1: on, more: width
+  if ( !mUnroll.empty() )
+    unroll = lower(mUnroll) == "off" ? 0 : count("unroll", mUnroll);
+  if ( lower(mVectorize) == "on" ) vectorize = 1;
+  else if ( lower(mVectorize) == "off" ) vectorize = 0;
+  else if ( !mVectorize.empty() ) vectorize = count("vectorize", mVectorize);
+
+  vector<Metadata*> ops = {nullptr}; // the loop id refers to itself
+  if ( unroll == 0 )
+    ops.push_back(loopHint(context, "llvm.loop.unroll.disable"));
+  else if ( unroll > 0 )
+    ops.push_back(loopHint(context, "llvm.loop.unroll.count",
+                           ConstantInt::get(i32, unroll)));
+  if ( vectorize >= 0 )
+    ops.push_back(loopHint(context, "llvm.loop.vectorize.enable",
+                           ConstantInt::get(Type::getInt1Ty(context),
+                                            vectorize > 0)));
+  if ( vectorize > 1 )
+    ops.push_back(loopHint(context, "llvm.loop.vectorize.width",
+                           ConstantInt::get(i32, vectorize)));
+  if ( ops.size() == 1 ) return;
+
+  MDNode * loopID = MDNode::getDistinct(context, ops);
+  loopID->replaceOperandWith(0, loopID);
+  latch->setMetadata("llvm.loop", loopID);
+}
+
+void Directives::setConstantLookup(
+    const function<bool(const string & ident, int & value)> & lookup)
+{
+  mConstantLookup = lookup;
+}
+
+int Directives::optLevel(const Function & f)
+{
+  Attribute attr = f.getAttributes().getAttribute(AttributeSet::FunctionIndex,
+                                                  OPT_LEVEL_ATTR);
+  if ( !attr.isStringAttribute() ) return -1;
+  return atoi(attr.getValueAsString().str().c_str());
+}
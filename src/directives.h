@@ -0,0 +1,50 @@
+#ifndef DIRECTIVES_H
+#define DIRECTIVES_H
+
+#include <functional>
+#include <string>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+using namespace llvm;
+using namespace std;
+
+/* compiler directives, {$...} comments in front of a callable declaration
+ * or a loop
+ *
+ *   {$O0} .. {$O3}          optimization level of the callable
+ *   {$hot}, {$cold}         the callable is called often/rarely
+ *   {$noinline}             the callable is never inlined
+ *   {$unroll N}             unroll the loop N times, {$unroll off} not at all
+ *   {$vectorize on|off|N}   (do not) vectorize the loop, N is the width
+ *
+ * they end up as function attributes or loop metadata. N is a number or
+ * a constant of the program, looked up once the loop is translated.
+ */
+class Directives {
+public:
+  Directives();
+  void parse(const string & text); // text between {$ and }
+
+  void apply(Function * f) const;
+  void apply(BranchInst * latch) const; // the branch back to the loop header
+
+  /* level of {$O1} .. {$O3}, -1 if the callable has none */
+  static int optLevel(const Function & f);
+
+  /* value of a constant named in a directive, false if there is none */
+  static void setConstantLookup(
+      const function<bool(const string & ident, int & value)> & lookup);
+private:
+  int count(const string & name, const string & arg) const;
+
+  int mOptLevel;     // -1: not set
+  string mUnroll;    // count or off, empty if not set
+  string mVectorize; // width, on or off, empty if not set
+  bool mHot;
+  bool mCold;
+  bool mNoInline;
+};
+
+#endif // DIRECTIVES_H
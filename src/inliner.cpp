@@ -0,0 +1,133 @@
+#include "inliner.h"
+
+#include <set>
+#include <vector>
+
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+using namespace std;
+
+static const unsigned INLINE_THRESHOLD = 40; // instructions
+static const char * PASS_NAME = "mila-inline"; // of the remarks
+
+/* callables of the program, not of the runtime */
+static bool isCallable(Function * f)
+{
+  return f && !f->isDeclaration() && !f->getName().startswith("__mila_");
+}
+
+static vector<CallInst*> callSites(Function & f)
+{
+  vector<CallInst*> calls;
+  for ( BasicBlock & bb : f )
+    for ( Instruction & I : bb )
+      if ( CallInst * call = dyn_cast<CallInst>(&I) )
+        if ( isCallable(call->getCalledFunction()) )
+          calls.push_back(call);
+  return calls;
+}
+
+static vector<CallInst*> callers(Function * callee)
+{
+  vector<CallInst*> calls;
+  for ( User * U : callee->users() )
+    if ( CallInst * call = dyn_cast<CallInst>(U) )
+      if ( call->getCalledFunction() == callee )
+        calls.push_back(call);
+  return calls;
+}
+
+/* a missed optimization remark at every call of callee */
+static void notInlined(Function * callee, const string & why)
+{
+  for ( CallInst * call : callers(callee) ) {
+    Function * caller = call->getParent()->getParent();
+    emitOptimizationRemarkMissed(caller->getContext(), PASS_NAME, *caller,
+                                 call->getDebugLoc(),
+                                 callee->getName() + " not inlined into "
+                                 + caller->getName() + ": " + why);
+  }
+}
+
+static unsigned cost(Function & f)
+{
+  unsigned size = 0;
+  for ( BasicBlock & bb : f )
+    for ( Instruction & I : bb )
+      if ( !isa<AllocaInst>(I) ) size++;
+  return size;
+}
+
+static void postOrder(Function * f, set<Function*> & visited,
+                      vector<Function*> & order)
+{
+  if ( !visited.insert(f).second ) return;
+  for ( CallInst * call : callSites(*f) )
+    postOrder(call->getCalledFunction(), visited, order);
+  order.push_back(f);
+}
+
+static bool reaches(Function * from, Function * to, set<Function*> & visited)
+{
+  for ( CallInst * call : callSites(*from) ) {
+    Function * callee = call->getCalledFunction();
+    if ( callee == to ) return true;
+    if ( visited.insert(callee).second && reaches(callee, to, visited) )
+      return true;
+  }
+  return false;
+}
+
+void inliner_run(Module & module, bool automatic, bool report)
+{
+  vector<Function*> order;
+  set<Function*> visited;
+  for ( Function & f : module )
+    if ( isCallable(&f) ) postOrder(&f, visited, order);
+
+  for ( Function * callee : order ) {
+    if ( callee->use_empty() ||
+         callee->hasFnAttribute(Attribute::NoInline) ) continue;
+    bool forced = callee->hasFnAttribute(Attribute::AlwaysInline);
+    if ( !forced && !automatic ) continue;
+
+    set<Function*> cycle;
+    if ( reaches(callee, callee, cycle) ) {
+      if ( report )
+        errs() << "not inlined " << callee->getName() << ": recursive\n";
+      notInlined(callee, "recursive");
+      continue;
+    }
+    unsigned size = cost(*callee);
+    if ( !forced && size > INLINE_THRESHOLD ) {
+      if ( report )
+        errs() << "not inlined " << callee->getName() << ": cost " << size
+               << " over threshold " << INLINE_THRESHOLD << "\n";
+      notInlined(callee, "cost " + to_string(size) + " over threshold "
+                 + to_string(INLINE_THRESHOLD));
+      continue;
+    }
+
+    /* a guaranteed tail call is no longer one once inlined */
+    for ( CallInst * call : callSites(*callee) )
+      if ( call->isMustTailCall() )
+        call->setTailCallKind(CallInst::TCK_Tail);
+
+    for ( CallInst * call : callers(callee) ) {
+      Function * caller = call->getParent()->getParent();
+      DebugLoc loc = call->getDebugLoc();
+      InlineFunctionInfo IFI;
+      if ( !InlineFunction(call, IFI) ) continue;
+      if ( report )
+        errs() << "inlined " << callee->getName() << " into "
+               << caller->getName() << " (cost " << size
+               << (forced ? ", inline" : "") << ")\n";
+      emitOptimizationRemark(caller->getContext(), PASS_NAME, *caller, loc,
+                             callee->getName() + " inlined into "
+                             + caller->getName());
+    }
+  }
+}
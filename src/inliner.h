@@ -0,0 +1,21 @@
+#ifndef INLINER_H
+#define INLINER_H
+
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+
+/* front end inliner
+ *
+ * callables declared inline are inlined into all of their callers, at every
+ * optimization level. with automatic inlining (-O1 and above) so are small
+ * callables, measured in instructions of the translated code, which also
+ * saves the spills of the arguments into their variables. recursive
+ * callables are never inlined. callees are processed before their callers,
+ * so that a caller's size includes what was inlined into it. with report,
+ * every decision is written to stderr, it is always emitted as an
+ * optimization remark of the mila-inline pass.
+ */
+void inliner_run(Module & module, bool automatic, bool report);
+
+#endif // INLINER_H
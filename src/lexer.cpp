@@ -15,8 +15,8 @@ const char * Token::TypeStr[] = {
   "kwIF", "kwTHEN", "kwELSE", "kwAND", "kwOR", "kwNOT",
   "kwBREAK", "kwWHILE", "kwDO",
   "kwFOR", "kwTO", "kwDOWNTO",
-  "kwOF", "kwPROGRAM",
-  "kwFUNCTION", "kwPROCEDURE", "kwFORWARD",
+  "kwCASE", "kwOF", "kwPROGRAM",
+  "kwFUNCTION", "kwPROCEDURE", "kwFORWARD", "kwINLINE",
   "EOI" };
 
 const struct {const char* word; Token::Type type;} keywordTable[] = {
@@ -38,11 +38,13 @@ const struct {const char* word; Token::Type type;} keywordTable[] = {
    {"for", Token::kwFOR},
    {"to", Token::kwTO},
    {"downto", Token::kwDOWNTO},
+   {"case", Token::kwCASE},
    {"of", Token::kwOF},
    {"program", Token::kwPROGRAM},
    {"function", Token::kwFUNCTION},
    {"procedure", Token::kwPROCEDURE},
    {"forward", Token::kwFORWARD},
+   {"inline", Token::kwINLINE},
    {NULL, (Token::Type) 0}
 };
 
@@ -68,16 +70,20 @@ Token Lexer::nextToken()
     bufferedTokens.pop_back();
     return t;
   }
+  ignoreDirectives();
 
   typedef Input::Symbol Symbol;
   Token token;
   int identSize;
+  std::string directive;
 q0: // start
   if ( !reddit ) mInput.readSymbol();
   else reddit = false;
   const Symbol & s = mInput.curSymbol();
   switch( s.symbol ) {
   case '{':
+    mInput.readSymbol();
+    if ( s.symbol == '$' ) goto q10;
     goto q1;
   case '+':
     token.type = Token::PLUS;
@@ -149,7 +155,6 @@ q0: // start
     error("Invalid symbol");
   }
 q1: // {
-  mInput.readSymbol();
   switch ( s.symbol ) {
   case '}':
     goto q0;
@@ -159,8 +164,25 @@ q1: // {
   case Symbol::END:
     error("Unterminated comment");
   default:
+    mInput.readSymbol();
     goto q1;
   }
+q10: // {$
+  mInput.readSymbol();
+  switch ( s.symbol ) {
+  case '}':
+    directives.push_back(directive);
+    directive.clear();
+    goto q0;
+  default:;
+  }
+  switch ( s.type ) {
+  case Symbol::END:
+    error("Unterminated directive");
+  default:
+    directive += s.symbol;
+    goto q10;
+  }
 q2: // ident or kw
   switch ( s.type ) {
   case Symbol::LETTER:
@@ -291,6 +313,20 @@ q9: // :
   assert ( false );
 }
 
+std::vector<std::string> Lexer::takeDirectives()
+{
+  std::vector<std::string> res;
+  res.swap(directives);
+  return res;
+}
+
+void Lexer::ignoreDirectives()
+{
+  for ( auto & text : takeDirectives() )
+    warning("directive {$" + text + "} is not in front of a loop or callable, "
+            "ignoring it");
+}
+
 void Lexer::returnToken(Token t)
 {
   bufferedTokens.push_back(t);
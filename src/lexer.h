@@ -2,6 +2,7 @@
 #define LEXER_H
 
 #include <iosfwd>
+#include <string>
 #include <vector>
 
 #include "input.h"
@@ -16,8 +17,8 @@ struct Token {
               kwIF, kwTHEN, kwELSE, kwAND, kwOR, kwNOT,
               kwBREAK, kwWHILE, kwDO,
               kwFOR, kwTO, kwDOWNTO,
-              kwOF, kwPROGRAM,
-              kwFUNCTION, kwPROCEDURE, kwFORWARD,
+              kwCASE, kwOF, kwPROGRAM,
+              kwFUNCTION, kwPROCEDURE, kwFORWARD, kwINLINE,
               EOI };
   static const int MAX_IDENT_LEN = 32;
 
@@ -38,6 +39,8 @@ private:
   /* if any tokens have been put back, nextToken() will return
    * tokens from this buffer first */
   std::vector<Token> bufferedTokens;
+
+  std::vector<std::string> directives; // {$...} read since takeDirectives()
 public:
   Lexer(std::istream & input);
   Token nextToken();
@@ -45,6 +48,14 @@ public:
 
   // reads all characters read till '
   void readString(std::string &str);
+
+  // directives in front of the current token (and not taken yet)
+  std::vector<std::string> takeDirectives();
+
+  // warns about the directives not taken and drops them. only loops and
+  // callables take them, so that those in front of any other token are
+  // ignored once the next one is read
+  void ignoreDirectives();
 };
 
 #endif // LEXER_H
@@ -0,0 +1,223 @@
+#include "linker.h"
+
+#include <cctype>
+#include <fstream>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "util.h"
+
+using namespace llvm;
+
+/* placeholders of the cached command line */
+static const char * OUTPUT = "@OUTPUT@";
+static const char * OBJECTS = "@OBJECTS@.o";
+
+/* outputFile gets both stdout and stderr */
+static int run(const string & program, const vector<string> & args,
+               const StringRef * outputFile = nullptr)
+{
+  vector<const char*> argv;
+  argv.push_back(program.c_str());
+  for ( auto & a : args )
+    argv.push_back(a.c_str());
+  argv.push_back(nullptr);
+
+  const StringRef * redirects[] = { nullptr, outputFile, outputFile };
+  string errMsg;
+  int code = sys::ExecuteAndWait(program, argv.data(), nullptr,
+                                 outputFile ? redirects : nullptr,
+                                 0, 0, &errMsg);
+  if ( code < 0 )
+    errs() << "Error: cannot run " << program << ": " << errMsg << '\n';
+  return code;
+}
+
+static string findProgram(const string & name)
+{
+  ErrorOr<string> path = sys::findProgramByName(name);
+  if ( !path ) {
+    errs() << "Error: " << name << " not found\n";
+    return "";
+  }
+  return *path;
+}
+
+/* splits a line of gcc -### output, arguments are "quoted" if needed */
+static vector<string> splitArgs(const string & line)
+{
+  vector<string> args;
+  string arg;
+  bool inArg = false, quoted = false;
+  for ( size_t i = 0 ; i < line.size() ; ++i ) {
+    char c = line[i];
+    if ( quoted && c == '\\' && i + 1 < line.size() ) {
+      arg += line[++i];
+    } else if ( c == '"' ) {
+      quoted = !quoted;
+      inArg = true;
+    } else if ( !quoted && isspace((unsigned char)c) ) {
+      if ( inArg ) args.push_back(arg);
+      arg.clear();
+      inArg = false;
+    } else {
+      arg += c;
+      inArg = true;
+    }
+  }
+  if ( inArg ) args.push_back(arg);
+  return args;
+}
+
+/* the lines a program prints, false if it fails */
+static bool capture(const string & program, const vector<string> & args,
+                    vector<string> & lines)
+{
+  SmallString<128> log;
+  if ( sys::fs::createTemporaryFile("mila-link", "txt", log) ) return false;
+  StringRef logRef(log);
+  int code = run(program, args, &logRef);
+
+  ifstream in(log.c_str());
+  string line;
+  lines.clear();
+  while ( getline(in, line) )
+    lines.push_back(line);
+  in.close();
+  sys::fs::remove(log.str());
+  return code == 0;
+}
+
+/* the linker gcc runs, which need not be the ld first on the path (a gcc
+ * built with its own binutils, a cross compiler); gcc prints just the name
+ * if it has none of its own */
+static string gccLinker(const string & gcc)
+{
+  vector<string> lines;
+  if ( !capture(gcc, { "-print-prog-name=ld" }, lines) || lines.empty() )
+    return "";
+  if ( sys::path::is_absolute(lines[0]) ) return lines[0];
+  return findProgram(lines[0]);
+}
+
+/* the linker run by gcc (collect2) followed by its arguments, without the
+ * lto plugin */
+static bool askGcc(bool isStatic, vector<string> & args)
+{
+  string gcc = findProgram("gcc");
+  if ( gcc.empty() ) return false;
+  string ld = gccLinker(gcc);
+  if ( ld.empty() ) return false;
+
+  vector<string> gccArgs = { "-###", OBJECTS, "-o", OUTPUT };
+  if ( isStatic ) gccArgs.insert(gccArgs.begin(), "-static");
+  vector<string> lines, command;
+  bool ok = capture(gcc, gccArgs, lines);
+  for ( auto & line : lines ) {
+    vector<string> tokens = splitArgs(line);
+    if ( !tokens.empty()
+         && sys::path::filename(tokens[0]).startswith("collect2") )
+      command = tokens;
+  }
+  if ( !ok || command.empty() ) return false;
+
+  args = { ld };
+  for ( size_t i = 1 ; i < command.size() ; ++i ) {
+    if ( command[i] == "-plugin" ) { ++i; continue; }
+    if ( StringRef(command[i]).startswith("-plugin-opt") ) continue;
+    args.push_back(command[i]);
+  }
+  return true;
+}
+
+/* the cached command line is stale once the files it names are gone */
+static bool readCache(const string & file, vector<string> & args)
+{
+  ifstream in(file);
+  if ( !in ) return false;
+  args.clear();
+  string arg;
+  while ( getline(in, arg) ) {
+    if ( sys::path::is_absolute(arg) && !sys::fs::exists(arg) ) return false;
+    args.push_back(arg);
+  }
+  /* the linker first, by its path */
+  return !args.empty() && sys::path::is_absolute(args[0]);
+}
+
+/* written to a unique file first, concurrent compiles may be writing the
+ * same cache */
+static void writeCache(const string & file, const vector<string> & args)
+{
+  string dir = sys::path::parent_path(file);
+  if ( sys::fs::create_directories(dir) ) return;
+  SmallString<128> tmp;
+  if ( sys::fs::createUniqueFile(file + "-%%%%%%%%", tmp) ) return;
+  {
+    ofstream out(tmp.c_str());
+    for ( auto & a : args )
+      out << a << '\n';
+    if ( !out ) {
+      out.close();
+      sys::fs::remove(tmp.str());
+      return;
+    }
+  }
+  if ( sys::fs::rename(tmp.str(), file) )
+    sys::fs::remove(tmp.str());
+}
+
+static bool linkCommand(bool isStatic, vector<string> & args)
+{
+  string dir = util_cacheDir();
+  string file;
+  if ( !dir.empty() ) {
+    SmallString<128> path(dir);
+    sys::path::append(path, isStatic ? "link-static.args" : "link.args");
+    file = path.str();
+    if ( readCache(file, args) ) return true;
+  }
+
+  if ( !askGcc(isStatic, args) ) return false;
+  if ( !file.empty() ) writeCache(file, args);
+  return true;
+}
+
+int linker_link(const vector<string> & objects, const string & output,
+                bool isStatic)
+{
+  vector<string> command;
+  if ( !linkCommand(isStatic, command) ) {
+    errs() << "Error: cannot find out how to link\n";
+    return 1;
+  }
+
+  vector<string> args;
+  for ( size_t i = 1 ; i < command.size() ; ++i ) {
+    const string & a = command[i];
+    if ( a == OUTPUT ) args.push_back(output);
+    else if ( a == OBJECTS ) args.insert(args.end(), objects.begin(),
+                                         objects.end());
+    else args.push_back(a);
+  }
+  return run(command[0], args) ? 1 : 0;
+}
+
+int linker_relocatable(const vector<string> & objects, const string & output)
+{
+  vector<string> command;
+  if ( !linkCommand(false, command) ) {
+    errs() << "Error: cannot find out how to link\n";
+    return 1;
+  }
+
+  vector<string> args = { "-r" };
+  args.insert(args.end(), objects.begin(), objects.end());
+  args.push_back("-o");
+  args.push_back(output);
+  return run(command[0], args) ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+#ifndef LINKER_H
+#define LINKER_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/* linking
+ *
+ * the linker of gcc (gcc -print-prog-name=ld) is run directly, without a
+ * shell and the gcc driver. the command line gcc would run it with (start
+ * files, library paths and libraries) is asked for once, with gcc -###,
+ * and kept together with the path of the linker in the cache
+ * directory ($XDG_CACHE_HOME/mila or ~/.cache/mila) for later compiles.
+ * it is asked for again when a file it names is gone.
+ *
+ * both return 0 on success.
+ */
+int linker_link(const vector<string> & objects, const string & output,
+                bool isStatic);
+
+/* merges the objects into a single one (ld -r) */
+int linker_relocatable(const vector<string> & objects, const string & output);
+
+#endif // LINKER_H
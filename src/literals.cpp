@@ -0,0 +1,29 @@
+#include "literals.h"
+
+#include <map>
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/ValueHandle.h"
+
+/* weak handles, the pooled globals may be erased (-fstream) */
+static map<pair<Module*, string>, WeakVH> mPool;
+
+Constant * literals_get(Module & module, const string & value)
+{
+  LLVMContext & context = module.getContext();
+  WeakVH & entry = mPool[make_pair(&module, value)];
+  GlobalVariable * gvar = cast_or_null<GlobalVariable>(entry);
+  if ( !gvar ) {
+    Constant * init = ConstantDataArray::getString(context, value);
+    gvar = new GlobalVariable(module, init->getType(), true,
+                              GlobalValue::PrivateLinkage, init, ".str");
+    gvar->setUnnamedAddr(true);
+    gvar->setAlignment(1);
+    entry = gvar;
+  }
+
+  Constant * zero = Constant::getNullValue(Type::getInt32Ty(context));
+  vector<Constant*> indices = {zero, zero};
+  return ConstantExpr::getGetElementPtr(gvar, indices);
+}
@@ -0,0 +1,21 @@
+#ifndef LITERALS_H
+#define LITERALS_H
+
+#include <string>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+using namespace std;
+
+/* string literal pool
+ *
+ * every distinct string is emitted once per module, as a private unnamed_addr
+ * constant, so that the code generator puts it into the mergeable string
+ * section and the linker merges equal strings of different object files.
+ * returns a pointer (i8*) to the first character.
+ */
+Constant * literals_get(Module & module, const string & value);
+
+#endif // LITERALS_H
@@ -1,7 +1,24 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <set>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
 
+#include "attributes.h"
+#include "cache.h"
+#include "directives.h"
+#include "inliner.h"
+#include "linker.h"
 #include "parser.h"
+#include "profile.h"
+#include "remarks.h"
+#include "util.h"
 
 #include "llvm/Analysis/Passes.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
@@ -14,12 +31,16 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/InitializePasses.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/CodeGen/CommandFlags.h"
 #include "llvm/CodeGen/LinkAllAsmWriterComponents.h"
 #include "llvm/CodeGen/LinkAllCodegenComponents.h"
@@ -37,21 +58,228 @@
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/PluginLoader.h"
 #include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetSubtargetInfo.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Vectorize.h"
 
 using namespace llvm;
 using namespace llvm::legacy;
 using namespace std;
 
-int createObjectFile(Module *mod, const char *targetName)
+static cl::opt<string>
+InputFilename(cl::Positional, cl::desc("<input program>"), cl::Required);
+
+static cl::opt<string>
+OutputFilename("o", cl::desc("Write the output to <file> (default a.out, or "
+                             "the input name with the extension of the "
+                             "output)"),
+               cl::value_desc("file"));
+
+static cl::opt<bool>
+CompileOnly("c", cl::desc("Compile to an object file, do not link"));
+
+static cl::opt<bool>
+EmitAssembly("S", cl::desc("Emit assembly, do not link"));
+
+static cl::opt<bool>
+EmitLLVM("emit-llvm", cl::desc("Emit LLVM IR, as bitcode with -c"));
+
+static cl::opt<bool>
+StaticLink("static", cl::desc("Link the program statically"));
+
+static cl::opt<string>
+CompileCache("fcompile-cache",
+             cl::desc("Reuse the output of an earlier compile of the same "
+                      "program with the same options, kept in <dir> "
+                      "(default ~/.cache/mila/outputs)"),
+             cl::value_desc("dir"), cl::ValueOptional);
+
+static cl::opt<unsigned>
+CompileCacheSize("fcompile-cache-size",
+                 cl::desc("Size limit of the compile cache (default 512)"),
+                 cl::value_desc("MiB"), cl::init(512));
+
+static cl::opt<bool>
+CompileCacheStats("fcompile-cache-stats",
+                  cl::desc("Print the hits and misses of the compile cache"));
+
+static cl::opt<bool>
+Watch("watch", cl::desc("Build the program again whenever it changes, "
+                        "compiling only the functions that changed"));
+
+static cl::opt<string>
+IncrementalDir("fincremental-dir",
+               cl::desc("Build once the way --watch does, with the objects "
+                        "of the functions kept in <dir>"),
+               cl::value_desc("dir"), cl::Hidden);
+
+static cl::opt<bool>
+DumpIR("d", cl::desc("Dump the generated LLVM IR"));
+
+static cl::opt<bool>
+PrintAST("p", cl::desc("Print the syntax tree"));
+
+static cl::opt<char>
+OptLevel("O", cl::desc("Optimization level. [-O0, -O1, -O2, or -O3] "
+                       "(default = '-O0')"),
+         cl::Prefix, cl::ZeroOrMore, cl::init('0'));
+
+static cl::opt<string>
+ProfileGenerate("fprofile-generate",
+                cl::desc("Instrument the program to write a branch profile "
+                         "to <file> (default mila.prof) on exit"),
+                cl::value_desc("file"), cl::ValueOptional);
+
+static cl::opt<string>
+ProfileUse("fprofile-use",
+           cl::desc("Optimize using the branch profile in <file>"),
+           cl::value_desc("file"));
+
+static cl::opt<unsigned>
+Jobs("j", cl::desc("Optimize and compile the program in <N> parallel "
+                   "partitions"),
+     cl::value_desc("N"), cl::Prefix, cl::init(1));
+
+static cl::opt<bool>
+InlineReport("finline-report",
+             cl::desc("Report which callables were inlined and why others "
+                      "were not"));
+
+static cl::opt<string>
+SaveOptRecord("fsave-optimization-record",
+              cl::desc("Write the optimization remarks, mapped to the "
+                       "callables and lines of the program, to <file> "
+                       "(default <output>.opt.yaml)"),
+              cl::value_desc("file"), cl::ValueOptional);
+
+static cl::opt<bool>
+BoundsCheck("fbounds-check",
+            cl::desc("Check that array indices are within the bounds, "
+                     "unless proven at compile time"));
+
+static cl::opt<bool>
+BoundsCheckReport("fbounds-check-report",
+                  cl::desc("Report which array accesses are checked and "
+                           "which are proven to be in bounds"));
+
+static cl::opt<bool>
+Stream("fstream", cl::desc("Translate and compile the program a chunk of "
+                           "functions at a time, with bounded memory"));
+
+/* small chunks make the tests go through several of them */
+static cl::opt<unsigned>
+StreamChunkSize("fstream-chunk-size",
+                cl::desc("Instructions of a chunk with -fstream "
+                         "(default 10000)"),
+                cl::value_desc("N"), cl::init(10000), cl::Hidden);
+
+static CodeGenOpt::Level codeGenOptLevel(unsigned optLevel)
+{
+  switch ( optLevel ) {
+  case 0: return CodeGenOpt::None;
+  case 1: return CodeGenOpt::Less;
+  case 2: return CodeGenOpt::Default;
+  default: return CodeGenOpt::Aggressive;
+  }
+}
+
+/* callables with a {$O<n>} directive above the level of the module get the
+ * function passes of -O<n> on their own, before the module pipeline */
+static void optimizeFunctions(Module *mod, TargetMachine *target,
+                              unsigned optLevel)
+{
+  for ( unsigned level = optLevel + 1 ; level <= 3 ; ++level )
+  {
+    vector<Function*> functions;
+    for ( Function & F : *mod )
+      if ( !F.isDeclaration() && Directives::optLevel(F) == (int)level )
+        functions.push_back(&F);
+    if ( functions.empty() )
+      continue;
+
+    TargetLibraryInfoImpl TLII(Triple(mod->getTargetTriple()));
+
+    FunctionPassManager FPM(mod);
+    FPM.add(new TargetLibraryInfoWrapperPass(TLII));
+    FPM.add(new DataLayoutPass());
+    FPM.add(createTargetTransformInfoWrapperPass(target->getTargetIRAnalysis()));
+    FPM.add(createPromoteMemoryToRegisterPass());
+    FPM.add(createInstructionCombiningPass());
+    FPM.add(createCFGSimplificationPass());
+    FPM.add(createEarlyCSEPass());
+    FPM.add(createReassociatePass());
+    FPM.add(createLoopRotatePass());
+    FPM.add(createLICMPass());
+    FPM.add(createIndVarSimplifyPass());
+    FPM.add(createLoopUnrollPass());
+    FPM.add(createGVNPass());
+    if ( level > 1 )
+    {
+      FPM.add(createLoopVectorizePass());
+      FPM.add(createSLPVectorizerPass());
+    }
+    FPM.add(createInstructionCombiningPass());
+    FPM.add(createCFGSimplificationPass());
+
+    FPM.doInitialization();
+    for ( Function * F : functions )
+      FPM.run(*F);
+    FPM.doFinalization();
+  }
+}
+
+/* runs the standard -O<n> IR pipeline (mem2reg, instcombine, gvn, licm,
+ * loop unrolling/vectorization, inlining, ...) over the whole module */
+static void optimizeModule(Module *mod, TargetMachine *target, unsigned optLevel)
+{
+  optimizeFunctions(mod, target, optLevel);
+  if ( optLevel == 0 ) return;
+
+  PassManagerBuilder Builder;
+  Builder.OptLevel = optLevel;
+  Builder.SizeLevel = 0;
+  Builder.Inliner = createFunctionInliningPass(optLevel, 0);
+  Builder.LoopVectorize = optLevel > 1;
+  Builder.SLPVectorize = optLevel > 1;
+  Builder.DisableUnrollLoops = false;
+
+  TargetLibraryInfoImpl TLII(Triple(mod->getTargetTriple()));
+
+  FunctionPassManager FPM(mod);
+  FPM.add(new TargetLibraryInfoWrapperPass(TLII));
+  FPM.add(new DataLayoutPass());
+  FPM.add(createTargetTransformInfoWrapperPass(target->getTargetIRAnalysis()));
+  Builder.populateFunctionPassManager(FPM);
+
+  FPM.doInitialization();
+  for ( Function & F : *mod )
+    FPM.run(F);
+  FPM.doFinalization();
+
+  PassManager MPM;
+  MPM.add(new TargetLibraryInfoWrapperPass(TLII));
+  MPM.add(new DataLayoutPass());
+  MPM.add(createTargetTransformInfoWrapperPass(target->getTargetIRAnalysis()));
+  Builder.populateModulePassManager(MPM);
+  MPM.add(createVerifierPass());
+  MPM.run(*mod);
+}
+
+static void initializeLLVM()
 {
   // Initialize targets first, so that --version shows registered targets.
   InitializeAllTargets();
@@ -63,12 +291,39 @@ int createObjectFile(Module *mod, const char *targetName)
   PassRegistry *Registry = PassRegistry::getPassRegistry();
   initializeCore(*Registry);
   initializeCodeGen(*Registry);
+  initializeScalarOpts(*Registry);
+  initializeVectorization(*Registry);
+  initializeIPO(*Registry);
+  initializeAnalysis(*Registry);
+  initializeIPA(*Registry);
+  initializeTransformUtils(*Registry);
+  initializeInstCombine(*Registry);
+  initializeTarget(*Registry);
   initializeLoopStrengthReducePass(*Registry);
   initializeLowerIntrinsicsPass(*Registry);
   initializeUnreachableBlockElimPass(*Registry);
+}
 
-  // Load the module to be compiled...
-  SMDiagnostic Err;
+/* -mcpu=native resolves to the host cpu and enables all of its features */
+static string hostCPU(SubtargetFeatures & Features)
+{
+  StringMap<bool> HostFeatures;
+  if (sys::getHostCPUFeatures(HostFeatures))
+    for (auto &F : HostFeatures)
+      Features.AddFeature(F.first(), F.second);
+  return sys::getHostCPUName();
+}
+
+/* the host cpu and its features, for the keys of the outputs built for it */
+static string hostCPUKey()
+{
+  SubtargetFeatures Features;
+  string CPU = hostCPU(Features);
+  return CPU + " " + Features.getString();
+}
+
+static TargetMachine * createTargetMachine(unsigned optLevel)
+{
   Triple TheTriple;
   TheTriple.setTriple(sys::getDefaultTargetTriple());
 
@@ -78,29 +333,45 @@ int createObjectFile(Module *mod, const char *targetName)
   if (!TheTarget)
   {
     errs() << "Error: " << Error;
-    return 1;
+    return nullptr;
   }
 
   // Package up features to be passed to target/subtarget
-  std::string FeaturesStr;
-  if (MAttrs.size())
-  {
-    SubtargetFeatures Features;
-    for (unsigned i = 0; i != MAttrs.size(); ++i)
-      Features.AddFeature(MAttrs[i]);
-    FeaturesStr = Features.getString();
-  }
+  // -mattr can still override individual features of -mcpu=native
+  std::string CPUStr = MCPU;
+  SubtargetFeatures Features;
+  if (CPUStr == "native")
+    CPUStr = hostCPU(Features);
+  for (unsigned i = 0; i != MAttrs.size(); ++i)
+    Features.AddFeature(MAttrs[i]);
+  std::string FeaturesStr = Features.getString();
 
-  CodeGenOpt::Level OLvl = CodeGenOpt::None;
+  CodeGenOpt::Level OLvl = codeGenOptLevel(optLevel);
   TargetOptions Options = InitTargetOptionsFromCodeGenFlags();
 
-  std::unique_ptr<TargetMachine> Target(TheTarget->createTargetMachine(TheTriple.getTriple(), MCPU, FeaturesStr, Options, RelocModel, CMModel, OLvl));
+  TargetMachine * Target = TheTarget->createTargetMachine(TheTriple.getTriple(), CPUStr, FeaturesStr, Options, RelocModel, CMModel, OLvl);
 
   assert(Target && "Could not allocate target machine!");
+  return Target;
+}
+
+static bool emitBitcode()
+{
+  return EmitLLVM && CompileOnly && !EmitAssembly;
+}
+
+/* optimizes the module and writes it as an object file (assembly with -S,
+ * IR with -emit-llvm) */
+static int emitObjectFile(Module *mod, TargetMachine *Target,
+                          const string & targetName, unsigned optLevel)
+{
+  remarks_collect(mod->getContext());
 
   // Open the file.
   std::error_code EC;
   sys::fs::OpenFlags OpenFlags = sys::fs::F_None;
+  if ((EmitAssembly || EmitLLVM) && !emitBitcode())
+    OpenFlags = sys::fs::F_Text;
   std::unique_ptr<tool_output_file> Out = llvm::make_unique<tool_output_file>(targetName, EC, OpenFlags);
   if (EC)
   {
@@ -112,6 +383,7 @@ int createObjectFile(Module *mod, const char *targetName)
   PassManager PM;
 
   // Add an appropriate TargetLibraryInfo pass for the module's triple.
+  mod->setTargetTriple(Target->getTargetTriple());
   TargetLibraryInfoImpl TLII(Triple(mod->getTargetTriple()));
 
   // The -disable-simplify-libcalls flag actually disables all builtin optzns.
@@ -122,6 +394,18 @@ int createObjectFile(Module *mod, const char *targetName)
     mod->setDataLayout(DL);
   PM.add(new DataLayoutPass());
 
+  optimizeModule(mod, Target, optLevel);
+
+  if (EmitLLVM)
+  {
+    if (emitBitcode())
+      WriteBitcodeToFile(mod, Out->os());
+    else
+      Out->os() << *mod;
+    Out->keep();
+    return 0;
+  }
+
   if (RelaxAll.getNumOccurrences() > 0 && FileType != TargetMachine::CGFT_ObjectFile)
     errs() << ": warning: ignoring -mc-relax-all because filetype != obj";
   {
@@ -148,15 +432,15 @@ int createObjectFile(Module *mod, const char *targetName)
     }
 
     // Ask the target to add backend passes as necessary.
-    if (Target->addPassesToEmitFile(PM, FOS, TargetMachine::CodeGenFileType::CGFT_ObjectFile, false,
+    TargetMachine::CodeGenFileType OutputType = EmitAssembly
+        ? TargetMachine::CodeGenFileType::CGFT_AssemblyFile
+        : TargetMachine::CodeGenFileType::CGFT_ObjectFile;
+    if (Target->addPassesToEmitFile(PM, FOS, OutputType, false,
       StartAfterID, StopAfterID)) {
       errs() << ": target does not support generation of this file type!\n";
       return 1;
     }
 
-    // Before executing passes, print the final values of the LLVM options.
-    cl::PrintOptionValues();
-
     PM.run(*mod);
   }
 
@@ -166,55 +450,920 @@ int createObjectFile(Module *mod, const char *targetName)
   return 0;
 }
 
+/* output files
+ *
+ * objects are written to temporaries with unique names next to the output,
+ * so that any number of compiles may run in the same directory at once.
+ * they are linked (or renamed to the output with -c) and removed.
+ */
+
+/* a.out, or the name of the input with the extension of the output */
+static string outputFileName()
+{
+  if (!OutputFilename.empty())
+    return OutputFilename;
+  if (!CompileOnly && !EmitAssembly && !EmitLLVM)
+    return "a.out";
+
+  const char *ext = ".o";
+  if (EmitLLVM)
+    ext = emitBitcode() ? ".bc" : ".ll";
+  else if (EmitAssembly)
+    ext = ".s";
+  return sys::path::stem(InputFilename).str() + ext;
+}
+
+/* appends a new temporary to objects, false if it cannot be created */
+static bool temporaryObject(const string & output, vector<string> & objects)
+{
+  SmallString<128> path;
+  std::error_code EC = sys::fs::createUniqueFile(output + "-%%%%%%%%.o", path);
+  if (EC)
+  {
+    errs() << "Error: cannot create a temporary file: " << EC.message()
+           << '\n';
+    return false;
+  }
+  objects.push_back(path.str());
+  return true;
+}
+
+/* links the objects into the executable, with -c merges them into a single
+ * object */
+static int linkOutput(const vector<string> & objects, const string & output)
+{
+  if (CompileOnly && objects.size() == 1)
+  {
+    std::error_code EC = sys::fs::rename(objects[0], output);
+    if (EC)
+      errs() << "Error: cannot write " << output << ": " << EC.message()
+             << '\n';
+    return EC ? 1 : 0;
+  }
+
+  if (CompileOnly)
+    return linker_relocatable(objects, output);
+  return linker_link(objects, output, StaticLink);
+}
+
+/* parallel code generation
+ *
+ * every function definition is assigned to one of the partitions, balanced
+ * by instruction count. a global variable belongs to the partition that uses
+ * it (partition 0 if it is used by several of them). values with local
+ * linkage used across partitions are turned into hidden external symbols.
+ * each worker thread then reads the module into its own context, turns
+ * everything it does not own into declarations, optimizes the rest and
+ * writes its own object file.
+ */
+typedef map<string, unsigned> Partitioning;
+
+static void collectUserPartitions(const Value *V, const Partitioning & owner,
+                                  set<unsigned> & parts)
+{
+  for (const User *U : V->users())
+  {
+    if (const Instruction *I = dyn_cast<Instruction>(U))
+      parts.insert(owner.find(I->getParent()->getParent()->getName().str())->second);
+    else if (isa<GlobalVariable>(U))
+      parts.insert(0);
+    else
+      collectUserPartitions(U, owner, parts);
+  }
+}
+
+static void assignGlobals(Module *mod, Partitioning & owner);
+
+static Partitioning partitionModule(Module *mod, unsigned jobs)
+{
+  Partitioning owner;
+
+  /* largest functions first, each to the least loaded partition */
+  vector<pair<unsigned, Function*>> functions;
+  for (Function &F : *mod)
+    if (!F.isDeclaration())
+    {
+      unsigned size = 0;
+      for (BasicBlock &BB : F)
+        size += BB.size();
+      functions.push_back(make_pair(size, &F));
+    }
+  std::sort(functions.begin(), functions.end(),
+            [](const pair<unsigned, Function*> &a,
+               const pair<unsigned, Function*> &b)
+            { return a.first > b.first; });
+
+  vector<unsigned> load(jobs, 0);
+  for (auto &f : functions)
+  {
+    unsigned part = min_element(load.begin(), load.end()) - load.begin();
+    load[part] += f.first;
+    owner[f.second->getName().str()] = part;
+  }
+
+  assignGlobals(mod, owner);
+  return owner;
+}
+
+/* every function definition is a partition of its own, functions are
+ * their names by partition */
+static Partitioning partitionByFunction(Module *mod,
+                                        vector<string> & functions)
+{
+  Partitioning owner;
+  for (Function &F : *mod)
+    if (!F.isDeclaration())
+    {
+      owner[F.getName().str()] = functions.size();
+      functions.push_back(F.getName().str());
+    }
+  assignGlobals(mod, owner);
+  return owner;
+}
+
+/* global variables go to the partition of their users, local values used
+ * by other partitions become hidden external symbols */
+static void assignGlobals(Module *mod, Partitioning & owner)
+{
+  for (GlobalVariable &G : mod->globals())
+  {
+    set<unsigned> parts;
+    collectUserPartitions(&G, owner, parts);
+    owner[G.getName().str()] = parts.size() == 1 ? *parts.begin() : 0;
+  }
+
+  /* local values referenced from other partitions have to be visible */
+  vector<GlobalValue*> values;
+  for (Function &F : *mod)
+    values.push_back(&F);
+  for (GlobalVariable &G : mod->globals())
+    values.push_back(&G);
+  for (GlobalValue *GV : values)
+  {
+    if (!GV->hasLocalLinkage())
+      continue;
+    set<unsigned> parts;
+    collectUserPartitions(GV, owner, parts);
+    parts.insert(owner[GV->getName().str()]);
+    if (parts.size() == 1)
+      continue;
+    unsigned part = owner[GV->getName().str()];
+    owner.erase(GV->getName().str());
+    GV->setName("__mila_" + GV->getName());
+    GV->setLinkage(GlobalValue::ExternalLinkage);
+    GV->setVisibility(GlobalValue::HiddenVisibility);
+    owner[GV->getName().str()] = part;
+  }
+}
+
+/* keeps only the definitions owned by the partition */
+static void extractPartition(Module *mod, const Partitioning & owner,
+                             unsigned part)
+{
+  for (Function &F : *mod)
+    if (!F.isDeclaration() && owner.find(F.getName().str())->second != part)
+      F.deleteBody();
+
+  for (Module::global_iterator it = mod->global_begin();
+       it != mod->global_end(); )
+  {
+    GlobalVariable *G = it++;
+    if (G->isDeclaration() || owner.find(G->getName().str())->second == part)
+      continue;
+    if (G->hasAppendingLinkage())
+    {
+      G->eraseFromParent();
+      continue;
+    }
+    G->setInitializer(nullptr);
+    G->setLinkage(GlobalValue::ExternalLinkage);
+  }
+}
+
+/* compiles the partitions parts[i] of the module into the files names[i],
+ * on up to jobs threads */
+static int compilePartitions(Module *mod, const Partitioning & owner,
+                             const vector<unsigned> & parts,
+                             const vector<string> & names,
+                             unsigned optLevel, unsigned jobs)
+{
+  SmallString<0> bitcode;
+  {
+    raw_svector_ostream OS(bitcode);
+    WriteBitcodeToFile(mod, OS);
+  }
+
+  vector<int> results(parts.size(), 1);
+  atomic<unsigned> next(0);
+  vector<thread> workers;
+  for (unsigned worker = 0; worker < min<size_t>(jobs, parts.size());
+       ++worker)
+  {
+    workers.push_back(thread([&]()
+    {
+      for (unsigned idx = next++; idx < parts.size(); idx = next++)
+      {
+        LLVMContext Context;
+        MemoryBufferRef Buffer(StringRef(bitcode.data(), bitcode.size()),
+                               names[idx]);
+        auto ModOrErr = parseBitcodeFile(Buffer, Context);
+        if (!ModOrErr)
+        {
+          errs() << "Error: " << ModOrErr.getError().message() << '\n';
+          continue;
+        }
+        std::unique_ptr<Module> M(std::move(*ModOrErr));
+        extractPartition(M.get(), owner, parts[idx]);
+
+        std::unique_ptr<TargetMachine> Target(createTargetMachine(optLevel));
+        if (Target)
+          results[idx] = emitObjectFile(M.get(), Target.get(), names[idx],
+                                        optLevel);
+      }
+    }));
+  }
+  for (thread &t : workers)
+    t.join();
+
+  for (int result : results)
+    if (result)
+      return result;
+  return 0;
+}
+
+static int createObjectFilesParallel(Module *mod, const string & output,
+                                     unsigned optLevel, unsigned jobs,
+                                     vector<string> & objects)
+{
+  Partitioning owner = partitionModule(mod, jobs);
+
+  vector<unsigned> parts;
+  vector<string> names;
+  for (unsigned part = 0; part < jobs; ++part)
+  {
+    parts.push_back(part);
+    if (!temporaryObject(output, names))
+    {
+      objects.insert(objects.end(), names.begin(), names.end());
+      return 1;
+    }
+  }
+  objects.insert(objects.end(), names.begin(), names.end());
+  return compilePartitions(mod, owner, parts, names, optLevel, jobs);
+}
+
+/* the object files are temporaries next to the output, appended to objects */
+int createObjectFiles(Module *mod, const string & output,
+                      unsigned optLevel, unsigned jobs,
+                      vector<string> & objects)
+{
+  initializeLLVM();
+
+  // Before executing passes, print the final values of the LLVM options.
+  cl::PrintOptionValues();
+
+  unsigned functions = 0;
+  for (Function &F : *mod)
+    if (!F.isDeclaration())
+      functions++;
+  jobs = min(jobs, functions);
+  if (jobs > 1 && !llvm_is_multithreaded())
+  {
+    errs() << "warning: LLVM was built without thread support, ignoring -j\n";
+    jobs = 1;
+  }
+  if (jobs > 1)
+    return createObjectFilesParallel(mod, output, optLevel, jobs, objects);
+
+  std::unique_ptr<TargetMachine> Target(createTargetMachine(optLevel));
+  if (!Target)
+    return 1;
+  if (!temporaryObject(output, objects))
+    return 1;
+  return emitObjectFile(mod, Target.get(), objects.back(), optLevel);
+}
+
+/* -S, -emit-llvm: a single file, written straight to the output */
+static int createOutputFile(Module *mod, const string & output,
+                            unsigned optLevel)
+{
+  initializeLLVM();
+  cl::PrintOptionValues();
+
+  std::unique_ptr<TargetMachine> Target(createTargetMachine(optLevel));
+  if (!Target)
+    return 1;
+  return emitObjectFile(mod, Target.get(), output, optLevel);
+}
+
+static void printAST(Statm *statm)
+{
+  printf("== print start ==\n");
+  statm->Print();
+  printf("== print end ==\n");
+}
+
+static void dumpIR(Module *mod)
+{
+  printf("== dump start ==\n");
+  mod->dump();
+  printf("== dump end ==\n");
+}
+
+/* streaming compilation
+ *
+ * every declaration is translated as soon as it is parsed and its syntax
+ * tree is released, except that of callables: constants declared later may
+ * call them at compile time. once the translated functions reach
+ * -fstream-chunk-size instructions (10000), the chunk is written to bitcode
+ * and compiled in a context of its own into its own object file. the module
+ * then forgets it: function bodies are deleted and global variables become
+ * declarations, so memory is bounded by the chunk size (or the largest
+ * function), not the program.
+ */
+
+static unsigned instructionCount(Module *mod)
+{
+  unsigned size = 0;
+  for (Function &F : *mod)
+    for (BasicBlock &BB : F)
+      size += BB.size();
+  return size;
+}
+
+/* values with internal linkage (symbols of the program and the runtime) may
+ * be referenced by later chunks, private ones (string literals) may not and
+ * internal constants are simply copied into every chunk */
+static void externalizeChunk(Module *mod)
+{
+  vector<GlobalValue*> values;
+  for (Function &F : *mod)
+    values.push_back(&F);
+  for (GlobalVariable &G : mod->globals())
+    if (!G.isConstant())
+      values.push_back(&G);
+  for (GlobalValue *GV : values)
+  {
+    if (!GV->hasInternalLinkage())
+      continue;
+    if (!GV->getName().startswith("__mila_"))
+      GV->setName("__mila_" + GV->getName());
+    GV->setLinkage(GlobalValue::ExternalLinkage);
+    GV->setVisibility(GlobalValue::HiddenVisibility);
+  }
+}
+
+/* keeps only the declarations of the compiled chunk */
+static void releaseChunk(Module *mod)
+{
+  for (Function &F : *mod)
+    if (!F.isDeclaration())
+      F.deleteBody();
+
+  for (Module::global_iterator it = mod->global_begin();
+       it != mod->global_end(); )
+  {
+    GlobalVariable *G = it++;
+    if (G->isDeclaration() || G->hasInternalLinkage())
+      continue;
+    if (G->hasAppendingLinkage())
+    {
+      G->eraseFromParent();
+      continue;
+    }
+    if (G->hasPrivateLinkage())
+    {
+      G->removeDeadConstantUsers();
+      if (G->use_empty())
+        G->eraseFromParent();
+      continue;
+    }
+    G->setInitializer(nullptr);
+  }
+}
+
+static int emitChunk(Module *mod, unsigned optLevel, const string & output,
+                     vector<string> & objects)
+{
+  inliner_run(*mod, optLevel > 0, InlineReport);
+  attributes_infer(*mod, false);
+  externalizeChunk(mod);
+  if (DumpIR)
+    dumpIR(mod);
+
+  SmallString<0> bitcode;
+  {
+    raw_svector_ostream OS(bitcode);
+    WriteBitcodeToFile(mod, OS);
+  }
+  releaseChunk(mod);
+
+  LLVMContext Context;
+  MemoryBufferRef Buffer(StringRef(bitcode.data(), bitcode.size()), "chunk");
+  auto ModOrErr = parseBitcodeFile(Buffer, Context);
+  if (!ModOrErr)
+  {
+    errs() << "Error: " << ModOrErr.getError().message() << '\n';
+    return 1;
+  }
+  std::unique_ptr<Module> M(std::move(*ModOrErr));
+  return createObjectFiles(M.get(), output, optLevel, Jobs, objects);
+}
+
+/* the key of the output: the program, the compiler, the target and the
+ * options, except those that only name the output */
+static bool initCache(int argc, char* argv[])
+{
+  string dir = CompileCache;
+  if (dir.empty())
+    dir = util_cacheDir().empty() ? "" : util_cacheDir() + "/outputs";
+  if (dir.empty())
+    return false;
+  cache_init(dir, (uint64_t)CompileCacheSize << 20);
+
+  string exe = sys::fs::getMainExecutable(argv[0], (void*)&initCache);
+  sys::fs::file_status st;
+  if (exe.empty() || sys::fs::status(exe, st))
+    return false;
+  cache_key(exe + " " + to_string(st.getSize()) + " "
+            + to_string(st.getLastModificationTime().toEpochTime()));
+  cache_key(sys::getDefaultTargetTriple());
+  if (MCPU == "native")
+    cache_key(hostCPUKey());
+
+  for (int i = 1; i < argc; ++i)
+  {
+    StringRef arg(argv[i]);
+    if (arg == "-o")
+      ++i;
+    else if (!arg.startswith("-o") && !arg.startswith("-fcompile-cache")
+             && arg != InputFilename)
+      cache_key(arg);
+  }
+  if (ProfileUse.getNumOccurrences() && !cache_keyFile(ProfileUse))
+    return false;
+  return cache_keyFile(InputFilename);
+}
+
+/* watch mode
+ *
+ * the program is built again whenever its file changes. every function is
+ * compiled into an object of its own, named by the hash of everything its
+ * machine code depends on: its IR after the front end inliner, the global
+ * variables it defines and the declarations of the values it refers to.
+ * the objects of unchanged functions are reused from earlier builds. every
+ * build runs in a child process, so that an error in the program does not
+ * end the watch. -fincremental-dir builds once the same way (for tests).
+ */
+static const unsigned WATCH_INTERVAL = 200; // ms
+
+static void printAttributes(raw_ostream & os, AttributeSet attrs)
+{
+  for (unsigned slot = 0; slot < attrs.getNumSlots(); ++slot)
+  {
+    unsigned idx = attrs.getSlotIndex(slot);
+    os << " " << idx << ":" << attrs.getAsString(idx);
+  }
+  os << "\n";
+}
+
+/* the printed IR refers to metadata by number, its contents are what
+ * matters */
+static void printMetadata(raw_ostream & os, const Metadata *MD,
+                          set<const Metadata*> & visited)
+{
+  if (!MD)
+    os << "null";
+  else if (const MDString *S = dyn_cast<MDString>(MD))
+    os << '"' << S->getString() << '"';
+  else if (const ValueAsMetadata *V = dyn_cast<ValueAsMetadata>(MD))
+    V->getValue()->printAsOperand(os);
+  else if (!visited.insert(MD).second)
+    os << "seen";
+  else
+  {
+    os << "!{";
+    for (const MDOperand &Op : cast<MDNode>(MD)->operands())
+    {
+      printMetadata(os, Op, visited);
+      os << ",";
+    }
+    os << "}";
+  }
+}
+
+/* numbers of attribute groups and metadata are module wide, they change
+ * with the other functions (their contents are hashed on their own) */
+static string stripSlots(const string & ir)
+{
+  string stripped;
+  bool quoted = false;
+  for (size_t i = 0; i < ir.size(); ++i)
+  {
+    char c = ir[i];
+    stripped += c;
+    if (c == '"')
+      quoted = !quoted;
+    if (!quoted && (c == '#' || c == '!'))
+      while (i + 1 < ir.size() && isdigit((unsigned char)ir[i+1]))
+        ++i;
+  }
+  return stripped;
+}
+
+static void collectGlobals(const Value *V, map<string, const GlobalValue*> & refs)
+{
+  if (const GlobalValue *GV = dyn_cast<GlobalValue>(V))
+    refs[GV->getName().str()] = GV;
+  else if (const Constant *C = dyn_cast<Constant>(V))
+    for (const Value *Op : C->operands())
+      collectGlobals(Op, refs);
+}
+
+static string partitionHash(Module *mod, const Partitioning & owner,
+                            unsigned part)
+{
+  auto owned = [&](const GlobalValue &GV)
+  {
+    auto it = owner.find(GV.getName().str());
+    return !GV.isDeclaration() && it != owner.end() && it->second == part;
+  };
+
+  string ir, text;
+  raw_string_ostream IRS(ir), os(text);
+  map<string, const GlobalValue*> refs;
+  set<const Metadata*> visited;
+  for (Function &F : *mod)
+  {
+    if (!owned(F))
+      continue;
+    F.print(IRS);
+    printAttributes(os, F.getAttributes());
+    for (BasicBlock &BB : F)
+      for (Instruction &I : BB)
+      {
+        SmallVector<pair<unsigned, MDNode*>, 4> MDs;
+        I.getAllMetadata(MDs);
+        for (auto &MD : MDs)
+        {
+          os << MD.first << "=";
+          printMetadata(os, MD.second, visited);
+        }
+        if (CallInst *CI = dyn_cast<CallInst>(&I))
+          printAttributes(os, CI->getAttributes());
+        for (Value *Op : I.operands())
+          collectGlobals(Op, refs);
+      }
+  }
+  for (GlobalVariable &G : mod->globals())
+    if (owned(G))
+    {
+      G.print(IRS);
+      IRS << "\n";
+      collectGlobals(G.getInitializer(), refs);
+    }
+
+  /* all the partition sees of the others */
+  for (auto &ref : refs)
+  {
+    const GlobalValue *GV = ref.second;
+    if (owned(*GV))
+      continue;
+    os << GV->getName() << " " << GV->getLinkage() << " "
+       << GV->getVisibility() << " ";
+    GV->getType()->print(os);
+    if (const Function *F = dyn_cast<Function>(GV))
+      printAttributes(os, F->getAttributes());
+    os << "\n";
+  }
+
+  MD5 hash;
+  hash.update(stripSlots(IRS.str()));
+  hash.update(os.str());
+  MD5::MD5Result result;
+  hash.final(result);
+  SmallString<32> hex;
+  MD5::stringifyResult(result, hex);
+  return hex.str();
+}
+
+/* compiles the functions that have no object in dir yet and links */
+static int buildIncrementally(Module *mod, const string & dir,
+                              const string & output, unsigned optLevel)
+{
+  initializeLLVM();
+
+  vector<string> functions;
+  Partitioning owner = partitionByFunction(mod, functions);
+  unsigned count = functions.size();
+  vector<string> objects;
+  vector<unsigned> parts;
+  vector<string> names, compiled;
+  bool failed = false;
+  for (unsigned part = 0; part < count; ++part)
+  {
+    objects.push_back(dir + "/" + partitionHash(mod, owner, part) + ".o");
+    if (sys::fs::exists(objects.back()))
+      continue;
+    /* unique, another watcher of the program may share dir */
+    SmallString<128> tmp;
+    std::error_code EC = sys::fs::createUniqueFile(objects.back()
+                                                   + "-%%%%%%%%", tmp);
+    if (EC)
+    {
+      errs() << "Error: cannot create a temporary file: " << EC.message()
+             << '\n';
+      failed = true;
+      break;
+    }
+    parts.push_back(part);
+    compiled.push_back(objects.back());
+    names.push_back(tmp.str());
+  }
+
+  unsigned jobs = llvm_is_multithreaded() ? max(1u, (unsigned)Jobs) : 1;
+  failed = failed || (!parts.empty()
+           && compilePartitions(mod, owner, parts, names, optLevel, jobs));
+  /* complete objects only, a build may be interrupted */
+  for (unsigned i = 0; i < names.size(); ++i)
+    if (failed || sys::fs::rename(names[i], compiled[i]))
+    {
+      sys::fs::remove(names[i]);
+      failed = true;
+    }
+  if (failed)
+    return 1;
+  outs() << "compiled " << parts.size() << " of " << count << " functions";
+  for (unsigned i = 0; i < parts.size(); ++i)
+    outs() << (i ? ", " : ": ") << functions[parts[i]];
+  outs() << "\n";
+
+  /* objects of functions that are gone or changed, the temporaries are
+   * left to the builds that write them */
+  set<string> used(objects.begin(), objects.end());
+  std::error_code EC;
+  for (sys::fs::directory_iterator it(dir, EC), end; it != end && !EC;
+       it.increment(EC))
+    if (sys::path::extension(it->path()) == ".o" && !used.count(it->path()))
+      sys::fs::remove(it->path());
+
+  return linker_link(objects, output, StaticLink);
+}
+
+/* objects of the earlier builds of the program with the same options */
+static string watchDir(int argc, char* argv[])
+{
+  if (util_cacheDir().empty())
+    return "";
+  SmallString<128> input(InputFilename);
+  if (sys::fs::make_absolute(input))
+    return "";
+  string exe = sys::fs::getMainExecutable(argv[0], (void*)&watchDir);
+  sys::fs::file_status st;
+  if (exe.empty() || sys::fs::status(exe, st))
+    return "";
+
+  MD5 hash;
+  hash.update(input.str());
+  hash.update(exe + " " + to_string(st.getSize()) + " "
+              + to_string(st.getLastModificationTime().toEpochTime()));
+  if (MCPU == "native")
+    hash.update(hostCPUKey() + "\n");
+  for (int i = 1; i < argc; ++i)
+  {
+    StringRef arg(argv[i]);
+    if (arg == "-o")
+      ++i;
+    else if (!arg.startswith("-o") && arg != InputFilename)
+      hash.update(arg.str() + "\n");
+  }
+  MD5::MD5Result result;
+  hash.final(result);
+  SmallString<32> hex;
+  MD5::stringifyResult(result, hex);
+  return util_cacheDir() + "/watch/" + hex.str().str();
+}
+
+/* the modification time has a resolution of a second, a save within the
+ * second the build started in would go unnoticed; the contents do not */
+static string contentHash(const string & file)
+{
+  ErrorOr<unique_ptr<MemoryBuffer>> buf = MemoryBuffer::getFile(file, -1,
+                                                                false);
+  if (!buf)
+    return "";
+  MD5 hash;
+  hash.update((*buf)->getBuffer());
+  MD5::MD5Result result;
+  hash.final(result);
+  SmallString<32> hex;
+  MD5::stringifyResult(result, hex);
+  return hex.str();
+}
+
+/* builds in a child process whenever the program changes, returns in the
+ * child */
+static void watch()
+{
+  for (;;)
+  {
+    string stamp = contentHash(InputFilename);
+    pid_t pid = fork();
+    if (pid == 0)
+      return;
+    if (pid < 0)
+    {
+      errs() << "Error: cannot start a build\n";
+      exit(1);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    outs() << (ok ? "build finished" : "build failed") << ", watching "
+           << InputFilename << "\n";
+    outs().flush();
+
+    while (contentHash(InputFilename) == stamp)
+      this_thread::sleep_for(chrono::milliseconds(WATCH_INTERVAL));
+  }
+}
+
 int main(int argc, char* argv[])
 {
-  if (argc < 2)
+  cl::ParseCommandLineOptions(argc, argv, "mila compiler\n");
+
+  if (OptLevel < '0' || OptLevel > '3')
   {
-    cout << "Usage: " << argv[0] << " programName [-d]" << endl;
-    exit(1);
+    errs() << argv[0] << ": invalid optimization level.\n";
+    return 1;
   }
+  unsigned optLevel = OptLevel - '0';
 
-  bool debug = false;
-  bool print = false;
-  for (int i = 2; i < argc; i++)
+  ProfileMode profileMode = ProfileMode::None;
+  string profileFile;
+  if (ProfileGenerate.getNumOccurrences() && ProfileUse.getNumOccurrences())
+  {
+    errs() << argv[0] << ": -fprofile-generate and -fprofile-use "
+              "cannot be combined.\n";
+    return 1;
+  }
+  if (ProfileGenerate.getNumOccurrences())
+  {
+    profileMode = ProfileMode::Generate;
+    profileFile = ProfileGenerate.empty() ? string("mila.prof")
+                                           : ProfileGenerate;
+  }
+  if (ProfileUse.getNumOccurrences())
   {
-    if (strcmp(argv[i], "-d") == 0)
-      debug = true;
-    if (strcmp(argv[i], "-p") == 0)
-      print = true;
+    profileMode = ProfileMode::Use;
+    profileFile = ProfileUse;
+  }
+  if (Stream && profileMode != ProfileMode::None)
+  {
+    errs() << argv[0] << ": -fstream cannot be combined with profiling.\n";
+    return 1;
+  }
+  if (Stream && SaveOptRecord.getNumOccurrences())
+  {
+    errs() << argv[0] << ": -fstream cannot be combined with "
+              "-fsave-optimization-record.\n";
+    return 1;
+  }
+  /* a single module is needed for a single assembly/IR file */
+  if ((EmitAssembly || EmitLLVM) && (Stream || Jobs > 1))
+  {
+    errs() << argv[0] << ": -S and -emit-llvm cannot be combined with "
+              "-fstream or -j.\n";
+    return 1;
+  }
+  bool incremental = Watch || IncrementalDir.getNumOccurrences();
+  if (incremental && (CompileOnly || EmitAssembly || EmitLLVM || Stream
+                      || CompileCache.getNumOccurrences()))
+  {
+    errs() << argv[0] << ": --watch builds executables, it cannot be "
+              "combined with -c, -S, -emit-llvm, -fstream or "
+              "-fcompile-cache.\n";
+    return 1;
+  }
+  string output = outputFileName();
+
+  string watchDirectory;
+  if (Watch)
+  {
+    watchDirectory = watchDir(argc, argv);
+    if (watchDirectory.empty() || sys::fs::create_directories(watchDirectory))
+    {
+      errs() << argv[0] << ": cannot create a directory for --watch.\n";
+      return 1;
+    }
+    watch();
+  }
+  else if (IncrementalDir.getNumOccurrences())
+  {
+    watchDirectory = IncrementalDir;
+    if (watchDirectory.empty() || sys::fs::create_directories(watchDirectory))
+    {
+      errs() << argv[0] << ": cannot create " << watchDirectory << ".\n";
+      return 1;
+    }
+  }
+
+  /* outputs other than the file are not cached */
+  bool cached = CompileCache.getNumOccurrences() && !DumpIR && !PrintAST
+                && !InlineReport && !BoundsCheckReport
+                && !SaveOptRecord.getNumOccurrences()
+                && initCache(argc, argv);
+  if (cached && cache_fetch(output))
+  {
+    if (CompileCacheStats)
+      cache_printStats();
+    return 0;
   }
 
   IRBuilder<> builder(getGlobalContext());
   Module * module = new Module("Mila", getGlobalContext());
-  
-  Parser parser(argv[1], getGlobalContext(), *module, builder);
+  profile_init(profileMode, profileFile, getGlobalContext(), *module, builder);
+  if (SaveOptRecord.getNumOccurrences())
+    remarks_init(InputFilename, *module, builder);
+  remarks_collect(getGlobalContext());
+
+  ast_boundsCheck(BoundsCheck, BoundsCheckReport);
+  Parser parser(InputFilename.c_str(), getGlobalContext(), *module, builder);
+  vector<string> objects;
+  int result = 0;
+  vector<unique_ptr<Statm>> callables;
+  if (Stream)
+    parser.setDeclHandler([&](Statm *decl)
+    {
+      if (PrintAST)
+        printAST(decl);
+      decl->Translate();
+      if (dynamic_cast<DeclCallable*>(decl))
+        callables.emplace_back(decl);
+      else
+        delete decl;
+      if (instructionCount(module) >= StreamChunkSize && !result)
+        result = emitChunk(module, optLevel, output, objects);
+    });
+
   StatmList * prog = parser.getStatements();
   if ( prog ) {
-    if ( print ) {
-      printf("== print start ==\n");
-      prog->Print();
-      printf("== print end ==\n");
-    }
+    if ( PrintAST )
+      printAST(prog);
+    /* the callables are translated already when streaming */
+    if ( !Stream ) DeclCallable::markReachable(prog);
     prog->Translate();
+    profile_finish();
+    remarks_finish();
+    if ( !Stream ) {
+      inliner_run(*module, optLevel > 0, InlineReport);
+      attributes_infer(*module);
+    }
   }
 
   delete prog;
+  callables.clear();
 
-  if (debug)
+  if (Stream)
+  {
+    if (!result)
+      result = emitChunk(module, optLevel, output, objects);
+  }
+  else
   {
-    printf("== dump start ==\n");
-    module->dump();
-    printf("== dump end ==\n");
+    if (DumpIR)
+      dumpIR(module);
+    if (EmitAssembly || EmitLLVM)
+      result = createOutputFile(module, output, optLevel);
+    else if (incremental)
+      result = buildIncrementally(module, watchDirectory, output, optLevel);
+    else
+      result = createObjectFiles(module, output, optLevel, Jobs, objects);
   }
 
-  createObjectFile(module, "a.o");
+  if (SaveOptRecord.getNumOccurrences())
+  {
+    string recordFile = SaveOptRecord.empty() ? output + ".opt.yaml"
+                                              : SaveOptRecord;
+    if (!remarks_write(recordFile))
+      errs() << argv[0] << ": cannot write " << recordFile << "\n";
+  }
   
   delete module;
 
   llvm_shutdown();
   
-  system("gcc a.o -o a.out");
-  
-  return 0;
+  if (!result && !objects.empty())
+    result = linkOutput(objects, output);
+  for (const string &object : objects)
+    sys::fs::remove(object);
+
+  if (cached && !result)
+    cache_store(output);
+  if (CompileCacheStats)
+    cache_printStats();
+
+  return result;
 }
 
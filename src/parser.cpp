@@ -63,12 +63,14 @@ StatmList *Parser::BodyStatements(bool main)
 {
   StatmList * initTail;
   StatmList * init = DeclStatements(initTail, main, true);
+  int line = util_lineNumber();
   Compare(Token::kwBEGIN);
 
   StatmList * next = ActionStatements();
   if ( !next ) next = new StatmList(new Program("no-op") ,0);
   if ( main ) {
     Statm * declMain = new DeclCallable("main", 0, new Integer(), next);
+    declMain->setLine(line);
     next = new StatmList(declMain, 0);
   }
 
@@ -87,6 +89,11 @@ StatmList *Parser::DeclStatements(StatmList *&last, bool main,
   if ( main ) p = MainDeclStatement(firstStatm);
   else p = DeclStatement();
   if ( !p ) return nullptr;
+  if ( main && mDeclHandler ) {
+    for ( ; p ; p = MainDeclStatement() )
+      mDeclHandler(p);
+    return nullptr;
+  }
   StatmList * next = DeclStatements(last, main);
   StatmList *su = new StatmList(p, next);
   if ( !next ) last = su;
@@ -118,10 +125,18 @@ Statm * Parser::DeclStatement() {
 }
 
 Statm * Parser::ActionStatement(Loop * parentLoop) {
+  int line = util_lineNumber();
+  Statm * s = ActionStatementImpl(parentLoop);
+  if ( s ) s->setLine(line);
+  return s;
+}
+
+Statm * Parser::ActionStatementImpl(Loop * parentLoop) {
   switch (Symb.type) {
   case Token::kwIF: return IfStatement(parentLoop);
   case Token::kwWHILE: return WhileStatement();
   case Token::kwFOR: return ForStatement();
+  case Token::kwCASE: return CaseStatement(parentLoop);
   case Token::kwBEGIN: return BlockStatements(parentLoop);
   default: return SimpleStatement(parentLoop);
   }
@@ -170,16 +185,19 @@ Statm *Parser::ElseStatement(Loop *parentLoop)
 
 Statm *Parser::WhileStatement()
 {
+  Directives directives = TakeDirectives();
   Symb = mLexer.nextToken();
   Expr * e = BoolExpression();
   Compare(Token::kwDO);
   While * whileStmt = new While();
+  whileStmt->setDirectives(directives);
   whileStmt->init(e, ActionStatement(whileStmt));
   return whileStmt;
 }
 
 Statm *Parser::ForStatement()
 {
+  Directives directives = TakeDirectives();
   Symb = mLexer.nextToken();
   if ( Symb.type != Token::IDENT )
     error("expected valid for-loop init expression");
@@ -195,10 +213,46 @@ Statm *Parser::ForStatement()
   Expr * limitExpr = Expression();
   Compare(Token::kwDO);
   For * forStmt = new For();
+  forStmt->setDirectives(directives);
   forStmt->init(initStmt, downto, limitExpr, ActionStatement(forStmt));
   return forStmt;
 }
 
+Statm *Parser::CaseStatement(Loop *parentLoop)
+{
+  Symb = mLexer.nextToken();
+  Case * caseStmt = new Case(Expression());
+  Compare(Token::kwOF);
+
+  while ( Symb.type != Token::kwEND && Symb.type != Token::kwELSE ) {
+    vector<pair<Expr*, Expr*>> labels; // from .. to, to is null if single
+    do {
+      if ( labels.size() ) Compare(Token::COMMA);
+      Expr * from = Expression();
+      Expr * to = nullptr;
+      if ( Symb.type == Token::DOT ) {
+        Compare(Token::DOT);
+        Compare(Token::DOT);
+        to = Expression();
+      }
+      labels.push_back(make_pair(from, to));
+    } while ( Symb.type == Token::COMMA );
+    Compare(Token::COLON);
+    caseStmt->addArm(labels, ActionStatement(parentLoop));
+  }
+
+  if ( Symb.type == Token::kwELSE ) {
+    Symb = mLexer.nextToken();
+    caseStmt->setElse(ActionStatement(parentLoop));
+  }
+
+  Compare(Token::kwEND);
+  // ; may not be present, as with blocks
+  if ( Symb.type != Token::kwEND && Symb.type != Token::kwELSE )
+    Compare(Token::SEMICOLON);
+  return caseStmt;
+}
+
 Statm *Parser::ProgramStatement()
 {
   Symb = mLexer.nextToken();
@@ -565,17 +619,36 @@ StatmList *Parser::DeclConstStatementImpl(bool optional)
   if ( optional && Symb.type != Token::IDENT ) return nullptr;
   else Compare_IDENT(&id);
 
-  if ( optional && Symb.type != Token::EQ ) {
+  if ( optional && Symb.type != Token::EQ && Symb.type != Token::COLON ) {
     mLexer.returnToken(Symb);
     mLexer.returnToken(backup);
     Symb = mLexer.nextToken();
     return nullptr;
   }
 
+  Object * type = nullptr;
+  if ( Symb.type == Token::COLON ) {
+    Symb = mLexer.nextToken();
+    type = DataTypeExpression();
+  }
   Compare(Token::EQ);
-  Expr * expr = Expression();
+  DeclConst * decl;
+  if ( type && type->getType() == Object::Array ) {
+    /* (e1, e2, ...) */
+    vector<Expr*> elements;
+    Compare(Token::LPAR);
+    elements.push_back(Expression());
+    while ( Symb.type == Token::COMMA ) {
+      Symb = mLexer.nextToken();
+      elements.push_back(Expression());
+    }
+    Compare(Token::RPAR);
+    decl = new DeclConst(id, elements, type);
+  } else {
+    decl = new DeclConst(id, Expression(), type ? type : new Integer());
+  }
   Compare(Token::SEMICOLON);
-  return new StatmList(new DeclConst(id, expr, new Integer()), DeclConstStatementImpl(true));
+  return new StatmList(decl, DeclConstStatementImpl(true));
 }
 
 Statm *Parser::DeclCallableStatement(Token::Type type)
@@ -585,6 +658,8 @@ Statm *Parser::DeclCallableStatement(Token::Type type)
   StatmList * params = nullptr;
   Object * returnType = nullptr;
   StatmList * body = nullptr;
+  Directives directives = TakeDirectives();
+  int line = util_lineNumber();
 
   Symb = mLexer.nextToken();
   Compare_IDENT(&ident);
@@ -597,13 +672,31 @@ Statm *Parser::DeclCallableStatement(Token::Type type)
     returnType = DataTypeExpression(true);
   }
   Compare(Token::SEMICOLON);
+  bool isInline = false;
+  if ( Symb.type == Token::kwINLINE ) {
+    Compare(Token::kwINLINE);
+    Compare(Token::SEMICOLON);
+    isInline = true;
+  }
   if ( Symb.type == Token::kwFORWARD ) {
     Compare(Token::kwFORWARD);
     Compare(Token::SEMICOLON);
   } else {
     body = BodyStatements();
   }
-  return new DeclCallable(ident, params, returnType, body);
+  DeclCallable * decl = new DeclCallable(ident, params, returnType, body,
+                                         isInline);
+  decl->setDirectives(directives);
+  decl->setLine(line);
+  return decl;
+}
+
+Directives Parser::TakeDirectives()
+{
+  Directives directives;
+  for ( auto & text : mLexer.takeDirectives() )
+    directives.parse(text);
+  return directives;
 }
 
 Parser::Parser(const char *fileName,
@@ -618,7 +711,14 @@ Parser::Parser(const char *fileName,
 
 StatmList *Parser::getStatements()
 {
-  return BodyStatements(true);
+  StatmList * statements = BodyStatements(true);
+  mLexer.ignoreDirectives(); // after the end of the program
+  return statements;
+}
+
+void Parser::setDeclHandler(const std::function<void (Statm *)> &handler)
+{
+  mDeclHandler = handler;
 }
 
 
@@ -2,6 +2,7 @@
 #define PARSER_H
 
 #include <fstream>
+#include <functional>
 
 #include "ast.h"
 #include "lexer.h"
@@ -17,7 +18,13 @@ public:
          LLVMContext & context, Module & module, IRBuilder<> & builder);
 
   StatmList * getStatements();
+
+  /* streaming: every top level declaration (not main) is passed to the
+   * handler as soon as it is parsed and is not part of getStatements() */
+  void setDeclHandler(const std::function<void(Statm*)> & handler);
 private:
+  std::function<void(Statm*)> mDeclHandler;
+
   void CompareError(Token::Type s);
   void CompareError(Token::Type expect, Token::Type get);
   void ExpansionError(const char* nonterminal, Token::Type s);
@@ -37,7 +44,8 @@ private:
   Statm * DeclStatement();
 
   StatmList * ActionStatements();
-  Statm * ActionStatement(Loop * parentLoop = 0);
+  Statm * ActionStatement(Loop * parentLoop = 0); // wrapper to record the line
+  Statm * ActionStatementImpl(Loop * parentLoop = 0);
 
   /* statements */
 
@@ -47,6 +55,7 @@ private:
   Statm * ElseStatement(Loop * parentLoop = 0);
   Statm * WhileStatement();
   Statm * ForStatement();
+  Statm * CaseStatement(Loop * parentLoop = 0);
   Statm * ProgramStatement();
   Call * CallStatement(const string & ident, bool noParams);
   Call * WriteStatement();
@@ -85,6 +94,9 @@ private:
 
   /* decl callable */
   Statm * DeclCallableStatement(Token::Type type);
+
+  /* {$...} directives in front of the current token */
+  Directives TakeDirectives();
 };
 
 #endif // PARSER_H
@@ -0,0 +1,299 @@
+#include "profile.h"
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include "literals.h"
+#include "util.h"
+
+/* a function entered at least HOT_RATIO times as often as the most
+ * frequently entered one is hot, at most COLD_RATIO times is cold
+ * (same thresholds as clang) */
+static const double HOT_RATIO = 0.3;
+static const double COLD_RATIO = 0.01;
+
+/* weights of likely()/unlikely() branches, same as llvm.expect gets */
+static const uint32_t LIKELY_WEIGHT = 64;
+static const uint32_t UNLIKELY_WEIGHT = 4;
+
+static ProfileMode mMode = ProfileMode::None;
+static string mFile;
+static LLVMContext * mContext;
+static Module * mModule;
+static IRBuilder<> * mBuilder;
+
+/* Generate */
+static vector<GlobalVariable*> mCounters; // all counters of the module
+static vector<pair<string, unsigned>> mFunctions; // ident, counter count
+
+/* Use */
+static map<string, vector<uint64_t>> mProfile;
+static uint64_t mMaxEntryCount;
+
+/* state of the function being translated */
+static Function * mFunction;
+static string mFIdent;
+static unsigned mFCounters;
+static vector<pair<BranchInst*, unsigned>> mFBranches; // branch, first counter
+
+static bool readProfile()
+{
+  ifstream in(mFile);
+  string magic;
+  unsigned functions, counters;
+  if ( !(in >> magic >> functions >> counters) || magic != "mila-profile" )
+    return false;
+
+  vector<pair<string, unsigned>> layout(functions);
+  for ( auto & f : layout )
+    if ( !(in >> f.first >> f.second) ) return false;
+
+  mMaxEntryCount = 0;
+  for ( auto & f : layout ) {
+    vector<uint64_t> & values = mProfile[f.first];
+    values.resize(f.second);
+    for ( auto & v : values )
+      if ( !(in >> v) ) return false;
+    if ( values.size() && f.first != "main" )
+      mMaxEntryCount = max(mMaxEntryCount, values[0]);
+  }
+  return true;
+}
+
+void profile_init(ProfileMode mode, const string & file,
+                  LLVMContext & context, Module & module,
+                  IRBuilder<> & builder)
+{
+  mMode = mode;
+  mFile = file;
+  mContext = &context;
+  mModule = &module;
+  mBuilder = &builder;
+  mFunction = nullptr;
+
+  if ( mMode == ProfileMode::Use && !readProfile() ) {
+    warning("cannot read profile '" + mFile + "', ignoring it");
+    mMode = ProfileMode::None;
+  }
+}
+
+/* creates a new counter of the current function */
+static GlobalVariable * newCounter()
+{
+  Type * i64 = Type::getInt64Ty(*mContext);
+  GlobalVariable * c = new GlobalVariable(*mModule, i64, false,
+                                          GlobalValue::PrivateLinkage,
+                                          ConstantInt::get(i64, 0),
+                                          "__mila_prof_counter");
+  mCounters.push_back(c);
+  mFCounters++;
+  return c;
+}
+
+static void increment(Value * counter)
+{
+  Value * v = mBuilder->CreateLoad(counter);
+  v = mBuilder->CreateAdd(v, ConstantInt::get(v->getType(), 1));
+  mBuilder->CreateStore(v, counter);
+}
+
+void profile_function(Function * f, const string & ident)
+{
+  mFunction = f;
+  mFIdent = ident;
+  mFCounters = 0;
+  mFBranches.clear();
+
+  if ( mMode == ProfileMode::Generate )
+    increment(newCounter()); // entry count
+  else
+    mFCounters++;
+}
+
+/* scales 64 bit counts down to the 32 bit branch weights */
+static MDNode * branchWeights(uint64_t t, uint64_t f)
+{
+  uint64_t scale = max(t, f) / UINT32_MAX + 1;
+  return MDBuilder(*mContext).createBranchWeights(t / scale + 1,
+                                                  f / scale + 1);
+}
+
+void profile_functionEnd()
+{
+  if ( mMode == ProfileMode::Generate )
+    mFunctions.push_back(make_pair(mFIdent, mFCounters));
+
+  if ( mMode == ProfileMode::Use ) {
+    auto it = mProfile.find(mFIdent);
+    if ( it == mProfile.end() ) {
+      warning("no profile data for '" + mFIdent + "'");
+    } else if ( it->second.size() != mFCounters ) {
+      warning("profile data for '" + mFIdent
+              + "' does not match the program, ignoring it");
+    } else {
+      const vector<uint64_t> & counts = it->second;
+      for ( auto & b : mFBranches )
+        b.first->setMetadata(LLVMContext::MD_prof,
+                             branchWeights(counts[b.second],
+                                           counts[b.second+1]));
+
+      uint64_t entry = counts[0];
+      if ( mFIdent != "main" ) {
+        if ( entry >= (uint64_t)(HOT_RATIO * mMaxEntryCount) )
+          mFunction->addFnAttr(Attribute::InlineHint);
+        else if ( entry <= (uint64_t)(COLD_RATIO * mMaxEntryCount) )
+          mFunction->addFnAttr(Attribute::Cold);
+      }
+    }
+  }
+
+  mFunction = nullptr;
+  mFBranches.clear();
+}
+
+/* a condition computed by likely(e)/unlikely(e), possibly compared with
+ * false, weights the branch without a profile (a recorded one wins) */
+static void expectWeights(BranchInst * br)
+{
+  Value * cond = br->getCondition();
+  if ( ICmpInst * cmp = dyn_cast<ICmpInst>(cond) ) {
+    ConstantInt * zero = dyn_cast<ConstantInt>(cmp->getOperand(1));
+    if ( cmp->getPredicate() != ICmpInst::ICMP_NE || !zero || !zero->isZero() )
+      return;
+    cond = cmp->getOperand(0);
+  }
+
+  IntrinsicInst * expect = dyn_cast<IntrinsicInst>(cond);
+  if ( !expect || expect->getIntrinsicID() != Intrinsic::expect ) return;
+  ConstantInt * expected = dyn_cast<ConstantInt>(expect->getArgOperand(1));
+  if ( !expected ) return;
+
+  bool likely = !expected->isZero();
+  br->setMetadata(LLVMContext::MD_prof, MDBuilder(*mContext).createBranchWeights(
+                    likely ? LIKELY_WEIGHT : UNLIKELY_WEIGHT,
+                    likely ? UNLIKELY_WEIGHT : LIKELY_WEIGHT));
+}
+
+BranchInst * profile_condBr(Value * cond, BasicBlock * t, BasicBlock * f)
+{
+  if ( mMode == ProfileMode::Generate && mFunction ) {
+    GlobalVariable * taken = newCounter();
+    GlobalVariable * notTaken = newCounter();
+    increment(mBuilder->CreateSelect(cond, taken, notTaken));
+  }
+
+  BranchInst * br = mBuilder->CreateCondBr(cond, t, f);
+  expectWeights(br);
+
+  if ( mMode == ProfileMode::Use && mFunction ) {
+    mFBranches.push_back(make_pair(br, mFCounters));
+    mFCounters += 2;
+  }
+  return br;
+}
+
+/* void __mila_prof_dump()
+ * writes the header (the layout of the counters) followed by the counters */
+static Function * emitDump(GlobalVariable * counters, unsigned count)
+{
+  Type * i8p = Type::getInt8PtrTy(*mContext);
+  Type * i32 = Type::getInt32Ty(*mContext);
+
+  Constant * fopenF = mModule->getOrInsertFunction("fopen",
+        FunctionType::get(i8p, vector<Type*>{i8p, i8p}, false));
+  Constant * fputsF = mModule->getOrInsertFunction("fputs",
+        FunctionType::get(i32, vector<Type*>{i8p, i8p}, false));
+  Constant * fprintfF = mModule->getOrInsertFunction("fprintf",
+        FunctionType::get(i32, vector<Type*>{i8p, i8p}, true));
+  Constant * fcloseF = mModule->getOrInsertFunction("fclose",
+        FunctionType::get(i32, vector<Type*>{i8p}, false));
+
+  Function * dump = Function::Create(
+        FunctionType::get(Type::getVoidTy(*mContext), false),
+        GlobalValue::InternalLinkage, "__mila_prof_dump", mModule);
+
+  stringstream header;
+  header << "mila-profile " << mFunctions.size()
+         << " " << count << "\n";
+  for ( auto & f : mFunctions )
+    header << f.first << " " << f.second << "\n";
+
+  BasicBlock * entry = BasicBlock::Create(*mContext, "entry", dump);
+  BasicBlock * write = BasicBlock::Create(*mContext, "write", dump);
+  BasicBlock * loop = BasicBlock::Create(*mContext, "loop", dump);
+  BasicBlock * close = BasicBlock::Create(*mContext, "close", dump);
+  BasicBlock * ret = BasicBlock::Create(*mContext, "ret", dump);
+
+  IRBuilder<> b(entry);
+  Value * file = b.CreateCall(fopenF, vector<Value*>{
+                                literals_get(*mModule, mFile),
+                                literals_get(*mModule, "w")});
+  b.CreateCondBr(b.CreateIsNull(file), ret, write);
+
+  b.SetInsertPoint(write);
+  b.CreateCall(fputsF, vector<Value*>{
+                 literals_get(*mModule, header.str()), file});
+  Value * fmt = literals_get(*mModule, "%llu\n");
+  b.CreateBr(loop);
+
+  b.SetInsertPoint(loop);
+  PHINode * i = b.CreatePHI(i32, 2, "i");
+  i->addIncoming(ConstantInt::get(i32, 0), write);
+  Value * ptr = b.CreateGEP(counters, vector<Value*>{
+                              ConstantInt::get(i32, 0), i});
+  b.CreateCall(fprintfF, vector<Value*>{file, fmt, b.CreateLoad(ptr)});
+  Value * next = b.CreateAdd(i, ConstantInt::get(i32, 1));
+  i->addIncoming(next, loop);
+  b.CreateCondBr(b.CreateICmpEQ(next, ConstantInt::get(i32, count)),
+                 close, loop);
+
+  b.SetInsertPoint(close);
+  b.CreateCall(fcloseF, file);
+  b.CreateBr(ret);
+
+  b.SetInsertPoint(ret);
+  b.CreateRetVoid();
+
+  return dump;
+}
+
+void profile_finish()
+{
+  if ( mMode != ProfileMode::Generate || mCounters.empty() ) return;
+
+  /* merge the counters into a single array, so that they can be written
+   * in a loop */
+  Type * i32 = Type::getInt32Ty(*mContext);
+  unsigned count = mCounters.size();
+  ArrayType * arrTy = ArrayType::get(Type::getInt64Ty(*mContext), count);
+  GlobalVariable * counters = new GlobalVariable(
+        *mModule, arrTy, false, GlobalValue::InternalLinkage,
+        ConstantAggregateZero::get(arrTy), "__mila_prof_counters");
+  for ( unsigned idx = 0 ; idx < count ; ++idx ) {
+    vector<Constant*> indices = {ConstantInt::get(i32, 0),
+                                 ConstantInt::get(i32, idx)};
+    mCounters[idx]->replaceAllUsesWith(
+          ConstantExpr::getGetElementPtr(counters, indices));
+    mCounters[idx]->eraseFromParent();
+  }
+  mCounters.clear();
+  Function * dump = emitDump(counters, count);
+
+  /* register the dump to run at exit */
+  Constant * atexitF = mModule->getOrInsertFunction("atexit",
+        FunctionType::get(i32, vector<Type*>{dump->getType()}, false));
+  Function * reg = Function::Create(
+        FunctionType::get(Type::getVoidTy(*mContext), false),
+        GlobalValue::InternalLinkage, "__mila_prof_register", mModule);
+  IRBuilder<> b(BasicBlock::Create(*mContext, "entry", reg));
+  b.CreateCall(atexitF, dump);
+  b.CreateRetVoid();
+  appendToGlobalCtors(*mModule, reg, 0);
+}
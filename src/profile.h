@@ -0,0 +1,44 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <string>
+
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+using namespace std;
+
+/* profile guided optimization
+ *
+ * Generate: every function counts how many times it was entered and every
+ * if/while/for condition (and short-circuit and/or) counts how many times
+ * each of its two edges was taken. the counters are written to the profile file when the program exits.
+ *
+ * Use: the counters are read back and attached to the same branches as
+ * branch weights, function entry counts mark functions hot (inlinehint) or
+ * cold. counters are numbered in translation order, so the profile only
+ * applies to the same (unchanged) function it was generated from.
+ */
+enum class ProfileMode { None, Generate, Use };
+
+void profile_init(ProfileMode mode, const string & file,
+                  LLVMContext & context, Module & module,
+                  IRBuilder<> & builder);
+
+/* called at the beginning of the function body, the builder has to point
+ * to the entry block */
+void profile_function(Function * f, const string & ident);
+void profile_functionEnd();
+
+/* replacement for IRBuilder::CreateCondBr of profiled branches, also
+ * weights branches on likely()/unlikely() */
+BranchInst * profile_condBr(Value * cond, BasicBlock * t, BasicBlock * f);
+
+/* Generate: emits the counters and the code writing them on exit */
+void profile_finish();
+
+#endif // PROFILE_H
@@ -0,0 +1,170 @@
+#include "remarks.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/DiagnosticPrinter.h"
+#include "llvm/Support/Dwarf.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+struct Remark {
+  const char * kind; // Passed, Missed, Analysis, Failure
+  string pass;
+  string function;
+  string file;
+  unsigned line; // 0 if unknown
+  string message;
+};
+
+static bool mEnabled = false;
+static IRBuilder<> * mBuilder;
+static DIBuilder * mDIBuilder;
+static DIFile mFile;
+static DISubprogram mSubprogram; // of the function being translated
+
+static mutex mRemarksMutex; // the threads of -j report at the same time
+static vector<Remark> mRemarks;
+
+void remarks_init(const string & sourceFile, Module & module,
+                  IRBuilder<> & builder)
+{
+  mEnabled = true;
+  mBuilder = &builder;
+  mDIBuilder = new DIBuilder(module);
+
+  string dir = sys::path::parent_path(sourceFile);
+  string name = sys::path::filename(sourceFile);
+  if ( dir.empty() ) dir = ".";
+  mDIBuilder->createCompileUnit(dwarf::DW_LANG_Pascal83, name, dir, "mila",
+                                false, "", 0, "", DIBuilder::LineTablesOnly);
+  mFile = mDIBuilder->createFile(name, dir);
+  module.addModuleFlag(Module::Warning, "Debug Info Version",
+                       DEBUG_METADATA_VERSION);
+}
+
+void remarks_function(Function * f, const string & ident, int line)
+{
+  if ( !mEnabled ) return;
+  DICompositeType type = mDIBuilder->createSubroutineType(
+        mFile, mDIBuilder->getOrCreateTypeArray(None));
+  mSubprogram = mDIBuilder->createFunction(mFile, ident, f->getName(), mFile,
+                                           line, type, false, true, line,
+                                           0, false, f);
+  remarks_line(line);
+}
+
+void remarks_line(int line)
+{
+  if ( !mEnabled || !mSubprogram || line <= 0 ) return;
+  mBuilder->SetCurrentDebugLocation(DebugLoc::get(line, 0, mSubprogram));
+}
+
+void remarks_functionEnd()
+{
+  if ( !mEnabled ) return;
+  mSubprogram = DISubprogram();
+  mBuilder->SetCurrentDebugLocation(DebugLoc());
+}
+
+void remarks_finish()
+{
+  if ( !mEnabled || !mDIBuilder ) return;
+  mDIBuilder->finalize();
+  delete mDIBuilder;
+  mDIBuilder = nullptr;
+}
+
+static const char * severityStr(DiagnosticSeverity severity)
+{
+  switch ( severity ) {
+  case DS_Error: return "error";
+  case DS_Warning: return "warning";
+  case DS_Remark: return "remark";
+  case DS_Note: return "note";
+  }
+  return "";
+}
+
+static void handleDiagnostic(const DiagnosticInfo & DI, void *)
+{
+  const char * kind = nullptr;
+  switch ( DI.getKind() ) {
+  case DK_OptimizationRemark: kind = "Passed"; break;
+  case DK_OptimizationRemarkMissed: kind = "Missed"; break;
+  case DK_OptimizationRemarkAnalysis: kind = "Analysis"; break;
+  case DK_OptimizationFailure: kind = "Failure"; break;
+  default: break;
+  }
+
+  if ( !kind ) { // what the context does without a handler
+    DiagnosticPrinterRawOStream DP(errs());
+    errs() << severityStr(DI.getSeverity()) << ": ";
+    DI.print(DP);
+    errs() << "\n";
+    if ( DI.getSeverity() == DS_Error ) exit(1);
+    return;
+  }
+
+  const DiagnosticInfoOptimizationBase & OR =
+      static_cast<const DiagnosticInfoOptimizationBase &>(DI);
+  Remark r;
+  r.kind = kind;
+  r.pass = OR.getPassName();
+  r.function = OR.getFunction().getName();
+  if ( r.function.compare(0, 7, "__mila_") == 0 ) r.function.erase(0, 7);
+  r.line = 0;
+  if ( OR.isLocationAvailable() ) {
+    StringRef file;
+    unsigned line, column;
+    OR.getLocation(&file, &line, &column);
+    r.file = file;
+    r.line = line;
+  }
+  r.message = OR.getMsg().str();
+
+  lock_guard<mutex> lock(mRemarksMutex);
+  mRemarks.push_back(r);
+}
+
+void remarks_collect(LLVMContext & context)
+{
+  if ( !mEnabled ) return;
+  /* all of the remarks, not only those matching -pass-remarks */
+  context.setDiagnosticHandler(handleDiagnostic, nullptr, false);
+}
+
+static string quote(const string & s)
+{
+  string res = "'";
+  for ( char c : s ) {
+    if ( c == '\'' ) res += "''";
+    else if ( c == '\n' ) res += ' ';
+    else res += c;
+  }
+  return res + "'";
+}
+
+bool remarks_write(const string & file)
+{
+  ofstream out(file);
+  if ( !out ) return false;
+
+  lock_guard<mutex> lock(mRemarksMutex);
+  for ( const Remark & r : mRemarks ) {
+    out << "--- !" << r.kind << "\n"
+        << "Pass:            " << quote(r.pass) << "\n"
+        << "Function:        " << quote(r.function) << "\n";
+    if ( r.line )
+      out << "DebugLoc:        { File: " << quote(r.file)
+          << ", Line: " << r.line << " }\n";
+    out << "Message:         " << quote(r.message) << "\n"
+        << "...\n";
+  }
+  return (bool)out;
+}
@@ -0,0 +1,39 @@
+#ifndef REMARKS_H
+#define REMARKS_H
+
+#include <string>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+using namespace std;
+
+/* optimization remarks
+ *
+ * the translated callables get line table debug info, so that the remarks
+ * of the LLVM passes (loop vectorized or not and why, call inlined or not,
+ * ...) and of the front end inliner can be mapped back to the callables and
+ * lines of the program. the remarks are collected from every context the
+ * program is compiled in (-j) and written as YAML records at the end.
+ *
+ * nothing is done unless remarks_init was called.
+ */
+void remarks_init(const string & sourceFile, Module & module,
+                  IRBuilder<> & builder);
+
+/* called at the beginning of the function body, line of its declaration */
+void remarks_function(Function * f, const string & ident, int line);
+void remarks_line(int line); // the following instructions come from line
+void remarks_functionEnd();
+
+/* completes the debug info, once everything is translated */
+void remarks_finish();
+
+/* collects the remarks emitted in context */
+void remarks_collect(LLVMContext & context);
+bool remarks_write(const string & file);
+
+#endif // REMARKS_H
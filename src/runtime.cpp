@@ -0,0 +1,440 @@
+#include "runtime.h"
+
+#include <cstddef>
+#include <vector>
+
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include "literals.h"
+
+using namespace std;
+
+static const int BUFFER_SIZE = 4096;
+static const int MAX_NUMBER_LEN = 12; // "-2147483648\n"
+
+static LLVMContext * mContext;
+static Module * mModule;
+
+static Function * mWriteLn;
+static Function * mWrite;
+static Function * mReadLn;
+static Function * mFlush;
+static Function * mPeek;
+static Function * mBoundsError;
+static bool mRegistered;
+
+static GlobalVariable * mOut;    // [BUFFER_SIZE x i8]
+static GlobalVariable * mOutLen; // i32
+static GlobalVariable * mOutTTY; // i1, flush after each line
+static GlobalVariable * mIn;     // [BUFFER_SIZE x i8]
+static GlobalVariable * mInPos;  // i32
+static GlobalVariable * mInLen;  // i32
+
+void runtime_init(LLVMContext & context, Module & module)
+{
+  mContext = &context;
+  mModule = &module;
+  mWriteLn = mWrite = mReadLn = mFlush = mPeek = mBoundsError = nullptr;
+  mOut = mOutLen = mOutTTY = mIn = mInPos = mInLen = nullptr;
+  mRegistered = false;
+}
+
+/* helpers */
+
+static Type * i8() { return Type::getInt8Ty(*mContext); }
+static Type * i32() { return Type::getInt32Ty(*mContext); }
+static Type * sizeTy() { return Type::getIntNTy(*mContext, sizeof(size_t)*8); }
+
+static Constant * int32(int v)
+{
+  return ConstantInt::get(i32(), v, true);
+}
+
+static GlobalVariable * global(Type * ty, const char * name)
+{
+  return new GlobalVariable(*mModule, ty, false, GlobalValue::InternalLinkage,
+                            Constant::getNullValue(ty), name);
+}
+
+static GlobalVariable * buffer(const char * name)
+{
+  return global(ArrayType::get(i8(), BUFFER_SIZE), name);
+}
+
+static Value * element(IRBuilder<> & b, Value * arr, Value * idx)
+{
+  return b.CreateInBoundsGEP(arr, vector<Value*>{int32(0), idx});
+}
+
+static Function * newFunction(Type * ret, const vector<Type*> & args,
+                              const char * name)
+{
+  Function * f = Function::Create(FunctionType::get(ret, args, false),
+                                  GlobalValue::InternalLinkage,
+                                  name, mModule);
+  f->addFnAttr(Attribute::NoUnwind);
+  return f;
+}
+
+/* ssize_t write(int fd, const void * buf, size_t count) and read() */
+static Constant * libcIO(const char * name)
+{
+  return mModule->getOrInsertFunction(name,
+        FunctionType::get(sizeTy(),
+                          vector<Type*>{i32(), Type::getInt8PtrTy(*mContext),
+                                        sizeTy()},
+                          false));
+}
+
+/* output */
+
+static void declareOutput()
+{
+  if ( mOut ) return;
+  mOut = buffer("__mila_out");
+  mOutLen = global(i32(), "__mila_out_len");
+  mOutTTY = global(Type::getInt1Ty(*mContext), "__mila_out_tty");
+}
+
+/* void __mila_flush() */
+static Function * flush()
+{
+  if ( mFlush ) return mFlush;
+  declareOutput();
+  mFlush = newFunction(Type::getVoidTy(*mContext), {}, "__mila_flush");
+
+  BasicBlock * entry = BasicBlock::Create(*mContext, "entry", mFlush);
+  BasicBlock * loop = BasicBlock::Create(*mContext, "loop", mFlush);
+  BasicBlock * next = BasicBlock::Create(*mContext, "next", mFlush);
+  BasicBlock * ret = BasicBlock::Create(*mContext, "ret", mFlush);
+
+  IRBuilder<> b(entry);
+  Value * len = b.CreateLoad(mOutLen, "len");
+  b.CreateStore(int32(0), mOutLen);
+  b.CreateCondBr(b.CreateICmpEQ(len, int32(0)), ret, loop);
+
+  /* write() may write less than asked for */
+  b.SetInsertPoint(loop);
+  PHINode * off = b.CreatePHI(i32(), 2, "off");
+  off->addIncoming(int32(0), entry);
+  Value * n = b.CreateCall(libcIO("write"), vector<Value*>{int32(1),
+                            element(b, mOut, off),
+                            b.CreateZExt(b.CreateSub(len, off), sizeTy())});
+  n = b.CreateTrunc(n, i32());
+  b.CreateCondBr(b.CreateICmpSGT(n, int32(0)), next, ret);
+
+  b.SetInsertPoint(next);
+  Value * written = b.CreateAdd(off, n);
+  off->addIncoming(written, next);
+  b.CreateCondBr(b.CreateICmpSLT(written, len), loop, ret);
+
+  b.SetInsertPoint(ret);
+  b.CreateRetVoid();
+
+  return mFlush;
+}
+
+/* flushes the output at exit, finds out whether we are writing to a terminal */
+static void registerOutput()
+{
+  if ( mRegistered ) return;
+  mRegistered = true;
+
+  Function * f = flush();
+  Constant * atexitF = mModule->getOrInsertFunction("atexit",
+        FunctionType::get(i32(), vector<Type*>{f->getType()}, false));
+  Constant * isattyF = mModule->getOrInsertFunction("isatty",
+        FunctionType::get(i32(), vector<Type*>{i32()}, false));
+
+  Function * init = newFunction(Type::getVoidTy(*mContext), {},
+                                "__mila_rt_init");
+  IRBuilder<> b(BasicBlock::Create(*mContext, "entry", init));
+  Value * tty = b.CreateCall(isattyF, int32(1));
+  b.CreateStore(b.CreateICmpNE(tty, int32(0)), mOutTTY);
+  b.CreateCall(atexitF, f);
+  b.CreateRetVoid();
+  appendToGlobalCtors(*mModule, init, 0);
+}
+
+Function * runtime_write()
+{
+  if ( mWrite ) return mWrite;
+  registerOutput();
+  mWrite = newFunction(Type::getVoidTy(*mContext),
+                    {Type::getInt8PtrTy(*mContext), i32()}, "__mila_write");
+  Function::arg_iterator args = mWrite->arg_begin();
+  Value * str = args++;
+  Value * len = args;
+  str->setName("str");
+  len->setName("len");
+
+  BasicBlock * entry = BasicBlock::Create(*mContext, "entry", mWrite);
+  BasicBlock * full = BasicBlock::Create(*mContext, "full", mWrite);
+  BasicBlock * direct = BasicBlock::Create(*mContext, "direct", mWrite);
+  BasicBlock * copy = BasicBlock::Create(*mContext, "copy", mWrite);
+  BasicBlock * ret = BasicBlock::Create(*mContext, "ret", mWrite);
+
+  IRBuilder<> b(entry);
+  Value * used = b.CreateLoad(mOutLen);
+  b.CreateCondBr(b.CreateICmpSLE(b.CreateAdd(used, len), int32(BUFFER_SIZE)),
+                 copy, full);
+
+  b.SetInsertPoint(full);
+  b.CreateCall(flush());
+  b.CreateCondBr(b.CreateICmpSGT(len, int32(BUFFER_SIZE)), direct, copy);
+
+  /* does not fit into the buffer at all */
+  b.SetInsertPoint(direct);
+  b.CreateCall(libcIO("write"), vector<Value*>{int32(1), str,
+                                              b.CreateZExt(len, sizeTy())});
+  b.CreateBr(ret);
+
+  b.SetInsertPoint(copy);
+  used = b.CreateLoad(mOutLen);
+  b.CreateMemCpy(element(b, mOut, used), str, len, 1);
+  b.CreateStore(b.CreateAdd(used, len), mOutLen);
+  b.CreateBr(ret);
+
+  b.SetInsertPoint(ret);
+  b.CreateRetVoid();
+
+  return mWrite;
+}
+
+Function * runtime_writeln()
+{
+  if ( mWriteLn ) return mWriteLn;
+  registerOutput();
+  mWriteLn = newFunction(Type::getVoidTy(*mContext), {i32()}, "__mila_writeln");
+  Value * v = mWriteLn->arg_begin();
+  v->setName("v");
+
+  BasicBlock * entry = BasicBlock::Create(*mContext, "entry", mWriteLn);
+  BasicBlock * full = BasicBlock::Create(*mContext, "full", mWriteLn);
+  BasicBlock * format = BasicBlock::Create(*mContext, "format", mWriteLn);
+  BasicBlock * digit = BasicBlock::Create(*mContext, "digit", mWriteLn);
+  BasicBlock * sign = BasicBlock::Create(*mContext, "sign", mWriteLn);
+  BasicBlock * minus = BasicBlock::Create(*mContext, "minus", mWriteLn);
+  BasicBlock * copy = BasicBlock::Create(*mContext, "copy", mWriteLn);
+  BasicBlock * line = BasicBlock::Create(*mContext, "line", mWriteLn);
+  BasicBlock * ret = BasicBlock::Create(*mContext, "ret", mWriteLn);
+
+  /* the number is formatted backwards, newline first */
+  IRBuilder<> b(entry);
+  Value * tmp = b.CreateAlloca(ArrayType::get(i8(), MAX_NUMBER_LEN), 0, "tmp");
+  b.CreateStore(ConstantInt::get(i8(), '\n'),
+                element(b, tmp, int32(MAX_NUMBER_LEN-1)));
+  Value * used = b.CreateLoad(mOutLen);
+  b.CreateCondBr(b.CreateICmpSGT(used, int32(BUFFER_SIZE-MAX_NUMBER_LEN)),
+                 full, format);
+
+  b.SetInsertPoint(full);
+  b.CreateCall(flush());
+  b.CreateBr(format);
+
+  /* magnitude as unsigned, so that -2147483648 works */
+  b.SetInsertPoint(format);
+  Value * neg = b.CreateICmpSLT(v, int32(0));
+  Value * abs = b.CreateSelect(neg, b.CreateNeg(v), v);
+  b.CreateBr(digit);
+
+  b.SetInsertPoint(digit);
+  PHINode * pos = b.CreatePHI(i32(), 2, "pos");
+  PHINode * rest = b.CreatePHI(i32(), 2, "rest");
+  pos->addIncoming(int32(MAX_NUMBER_LEN-1), format);
+  rest->addIncoming(abs, format);
+  Value * newPos = b.CreateSub(pos, int32(1));
+  Value * c = b.CreateAdd(b.CreateTrunc(b.CreateURem(rest, int32(10)), i8()),
+                          ConstantInt::get(i8(), '0'));
+  b.CreateStore(c, element(b, tmp, newPos));
+  Value * newRest = b.CreateUDiv(rest, int32(10));
+  pos->addIncoming(newPos, digit);
+  rest->addIncoming(newRest, digit);
+  b.CreateCondBr(b.CreateICmpNE(newRest, int32(0)), digit, sign);
+
+  b.SetInsertPoint(sign);
+  b.CreateCondBr(neg, minus, copy);
+
+  b.SetInsertPoint(minus);
+  Value * minusPos = b.CreateSub(newPos, int32(1));
+  b.CreateStore(ConstantInt::get(i8(), '-'), element(b, tmp, minusPos));
+  b.CreateBr(copy);
+
+  b.SetInsertPoint(copy);
+  PHINode * start = b.CreatePHI(i32(), 2, "start");
+  start->addIncoming(newPos, sign);
+  start->addIncoming(minusPos, minus);
+  Value * len = b.CreateSub(int32(MAX_NUMBER_LEN), start);
+  used = b.CreateLoad(mOutLen);
+  b.CreateMemCpy(element(b, mOut, used), element(b, tmp, start), len, 1);
+  b.CreateStore(b.CreateAdd(used, len), mOutLen);
+  b.CreateCondBr(b.CreateLoad(mOutTTY), line, ret);
+
+  b.SetInsertPoint(line);
+  b.CreateCall(flush());
+  b.CreateBr(ret);
+
+  b.SetInsertPoint(ret);
+  b.CreateRetVoid();
+
+  return mWriteLn;
+}
+
+/* input */
+
+/* i32 __mila_peek()
+ * returns the next input character without consuming it, -1 at the end */
+static Function * peek()
+{
+  if ( mPeek ) return mPeek;
+  mIn = buffer("__mila_in");
+  mInPos = global(i32(), "__mila_in_pos");
+  mInLen = global(i32(), "__mila_in_len");
+  mPeek = newFunction(i32(), {}, "__mila_peek");
+
+  BasicBlock * entry = BasicBlock::Create(*mContext, "entry", mPeek);
+  BasicBlock * fill = BasicBlock::Create(*mContext, "fill", mPeek);
+  BasicBlock * refilled = BasicBlock::Create(*mContext, "refilled", mPeek);
+  BasicBlock * eof = BasicBlock::Create(*mContext, "eof", mPeek);
+  BasicBlock * have = BasicBlock::Create(*mContext, "have", mPeek);
+
+  IRBuilder<> b(entry);
+  Value * pos = b.CreateLoad(mInPos);
+  b.CreateCondBr(b.CreateICmpSLT(pos, b.CreateLoad(mInLen)), have, fill);
+
+  /* whatever was written so far has to be visible before we block */
+  b.SetInsertPoint(fill);
+  b.CreateCall(flush());
+  Value * n = b.CreateCall(libcIO("read"), vector<Value*>{int32(0),
+                            element(b, mIn, int32(0)),
+                            ConstantInt::get(sizeTy(), BUFFER_SIZE)});
+  n = b.CreateTrunc(n, i32());
+  b.CreateStore(int32(0), mInPos);
+  b.CreateCondBr(b.CreateICmpSGT(n, int32(0)), refilled, eof);
+
+  b.SetInsertPoint(refilled);
+  b.CreateStore(n, mInLen);
+  b.CreateBr(have);
+
+  b.SetInsertPoint(eof);
+  b.CreateStore(int32(0), mInLen);
+  b.CreateRet(int32(-1));
+
+  b.SetInsertPoint(have);
+  Value * c = b.CreateLoad(element(b, mIn, b.CreateLoad(mInPos)));
+  b.CreateRet(b.CreateZExt(c, i32()));
+
+  return mPeek;
+}
+
+static void consume(IRBuilder<> & b)
+{
+  b.CreateStore(b.CreateAdd(b.CreateLoad(mInPos), int32(1)), mInPos);
+}
+
+Function * runtime_readln()
+{
+  if ( mReadLn ) return mReadLn;
+  Function * peekF = peek();
+  mReadLn = newFunction(Type::getVoidTy(*mContext),
+                     {Type::getInt32PtrTy(*mContext)}, "__mila_readln");
+  Value * ptr = mReadLn->arg_begin();
+  ptr->setName("ptr");
+
+  BasicBlock * entry = BasicBlock::Create(*mContext, "entry", mReadLn);
+  BasicBlock * space = BasicBlock::Create(*mContext, "space", mReadLn);
+  BasicBlock * skip = BasicBlock::Create(*mContext, "skip", mReadLn);
+  BasicBlock * sign = BasicBlock::Create(*mContext, "sign", mReadLn);
+  BasicBlock * skipSign = BasicBlock::Create(*mContext, "skipsign", mReadLn);
+  BasicBlock * first = BasicBlock::Create(*mContext, "first", mReadLn);
+  BasicBlock * digit = BasicBlock::Create(*mContext, "digit", mReadLn);
+  BasicBlock * store = BasicBlock::Create(*mContext, "store", mReadLn);
+  BasicBlock * ret = BasicBlock::Create(*mContext, "ret", mReadLn);
+
+  IRBuilder<> b(entry);
+  b.CreateBr(space);
+
+  /* isspace() */
+  b.SetInsertPoint(space);
+  Value * c = b.CreateCall(peekF);
+  Value * isSpace = b.CreateOr(b.CreateICmpEQ(c, int32(' ')),
+                               b.CreateICmpULT(b.CreateSub(c, int32('\t')),
+                                               int32('\r'-'\t'+1)));
+  b.CreateCondBr(isSpace, skip, sign);
+
+  b.SetInsertPoint(skip);
+  consume(b);
+  b.CreateBr(space);
+
+  b.SetInsertPoint(sign);
+  Value * isMinus = b.CreateICmpEQ(c, int32('-'));
+  b.CreateCondBr(b.CreateOr(isMinus, b.CreateICmpEQ(c, int32('+'))),
+                 skipSign, first);
+
+  b.SetInsertPoint(skipSign);
+  consume(b);
+  b.CreateBr(first);
+
+  /* no digit, the variable keeps its value */
+  b.SetInsertPoint(first);
+  c = b.CreateCall(peekF);
+  Value * d = b.CreateSub(c, int32('0'));
+  b.CreateCondBr(b.CreateICmpULT(d, int32(10)), digit, ret);
+
+  b.SetInsertPoint(digit);
+  PHINode * acc = b.CreatePHI(i32(), 2, "acc");
+  PHINode * dig = b.CreatePHI(i32(), 2, "dig");
+  acc->addIncoming(int32(0), first);
+  dig->addIncoming(d, first);
+  consume(b);
+  Value * newAcc = b.CreateAdd(b.CreateMul(acc, int32(10)), dig);
+  Value * nextD = b.CreateSub(b.CreateCall(peekF), int32('0'));
+  acc->addIncoming(newAcc, digit);
+  dig->addIncoming(nextD, digit);
+  b.CreateCondBr(b.CreateICmpULT(nextD, int32(10)), digit, store);
+
+  b.SetInsertPoint(store);
+  b.CreateStore(b.CreateSelect(isMinus, b.CreateNeg(newAcc), newAcc), ptr);
+  b.CreateBr(ret);
+
+  b.SetInsertPoint(ret);
+  b.CreateRetVoid();
+
+  return mReadLn;
+}
+
+/* errors */
+
+/* the output written so far is flushed first, so that it precedes the
+ * error message */
+Function * runtime_boundsError()
+{
+  if ( mBoundsError ) return mBoundsError;
+  mBoundsError = newFunction(Type::getVoidTy(*mContext), {i32()},
+                             "__mila_bounds_error");
+  mBoundsError->addFnAttr(Attribute::NoReturn);
+  mBoundsError->addFnAttr(Attribute::Cold);
+  mBoundsError->addFnAttr(Attribute::NoInline);
+  Value * line = mBoundsError->arg_begin();
+  line->setName("line");
+
+  Constant * dprintfF = mModule->getOrInsertFunction("dprintf",
+        FunctionType::get(i32(), vector<Type*>{i32(),
+                                               Type::getInt8PtrTy(*mContext)},
+                          true));
+  Constant * exitF = mModule->getOrInsertFunction("exit",
+        FunctionType::get(Type::getVoidTy(*mContext), vector<Type*>{i32()},
+                          false));
+
+  IRBuilder<> b(BasicBlock::Create(*mContext, "entry", mBoundsError));
+  b.CreateCall(flush());
+  b.CreateCall(dprintfF, vector<Value*>{int32(2),
+                 literals_get(*mModule, "Error: array index out of bounds "
+                                        "on line %d\n"),
+                 line});
+  b.CreateCall(exitF, int32(1));
+  b.CreateUnreachable();
+
+  return mBoundsError;
+}
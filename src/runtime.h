@@ -0,0 +1,25 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+
+/* runtime library of the pre-defined functions
+ *
+ * the runtime is emitted as IR straight into the translated module (only the
+ * parts the program uses), with internal linkage. the optimizer can therefore
+ * inline it into the program and drop whatever ends up unused. output is
+ * buffered and written with write(2) when the buffer is full, before reading
+ * input, after every line on a terminal and at exit.
+ */
+void runtime_init(LLVMContext & context, Module & module);
+
+Function * runtime_writeln(); // void (i32): writes the number and a newline
+Function * runtime_write();   // void (i8*, i32): writes len characters
+Function * runtime_readln();  // void (i32*): reads a number, like scanf("%d")
+Function * runtime_boundsError(); // void (i32): reports the line and exits
+
+#endif // RUNTIME_H
@@ -56,13 +56,27 @@ void SymbolTable::declConst(string ident, Value * val, Object *o) {
     gvar = new GlobalVariable(mModule,
                               llvm::Type::getInt32Ty(mContext),
                               true,
-                              GlobalValue::ExternalLinkage,
+                              GlobalValue::InternalLinkage,
                               0, ident);
     gvar->setInitializer((Constant*)val);
     break;
   }
-  case Object::Array:
-    error("array cannot be const");
+  case Object::Array: {
+    Array * arr = ((Array*)o);
+    int from, to;
+    arr->initLimits();
+    arr->getLimits(from, to);
+    ArrayType * arrTy = cast<ArrayType>(val->getType());
+    if ( arrTy->getNumElements() != (uint64_t)(to - from + 1) )
+      error("array constant " + ident + " has "
+            + to_string(arrTy->getNumElements()) + " values, "
+            + to_string(to - from + 1) + " expected");
+    gvar = new GlobalVariable(mModule, arrTy, true,
+                              GlobalValue::InternalLinkage,
+                              (Constant*)val, ident);
+    gvar->setUnnamedAddr(true);
+    break;
+  }
   default: assert ( false );
   }
   curTable()[ident] = unique_ptr<Symbol>(new Symbol(o,Modifier::Const, gvar));
@@ -82,7 +96,7 @@ void SymbolTable::declVar(string ident, Object * o, bool first) { // todo: refac
       GlobalVariable * gvar = new GlobalVariable(mModule,
                                llvm::Type::getInt32Ty(mContext),
                                false,
-                               GlobalValue::ExternalLinkage,
+                               GlobalValue::InternalLinkage,
                                0, ident);
       gvar->setInitializer(ConstantInt::get(mContext, APInt(32, 0, true)));
       val = gvar;
@@ -101,7 +115,7 @@ void SymbolTable::declVar(string ident, Object * o, bool first) { // todo: refac
     GlobalVariable * gvar = new GlobalVariable(mModule,
                               arr_ty,
                               false,
-                              GlobalValue::CommonLinkage,
+                              GlobalValue::InternalLinkage,
                               0, ident);
     ConstantAggregateZero* agreg = ConstantAggregateZero::get(arr_ty);
     gvar->setInitializer(agreg); // todo: default values are not 0
@@ -136,6 +150,29 @@ void SymbolTable::declCallable(bool forward, string ident,
   (*t)[ident] = unique_ptr<Symbol>(new Symbol(o, Modifier::Var, f));
 }
 
+void SymbolTable::localizeGlobals()
+{
+  assert ( mLocalScope );
+  BasicBlock & entry = mFunction->getEntryBlock();
+  for ( auto & it : mTable ) {
+    Symbol & s = *it.second;
+    if ( s.type != Modifier::Var || s.obj->getType() != Object::Integer ||
+         mCallableRefs.count(it.first) )
+      continue;
+    /* arrays stay global, they might not fit on the stack */
+    GlobalVariable * gvar = dyn_cast<GlobalVariable>(s.val);
+    /* declarations only, if an earlier chunk has been compiled already */
+    if ( !gvar || gvar->isDeclaration() || !gvar->use_empty() ) continue;
+
+    IRBuilder<> tmp(&entry, entry.begin());
+    AllocaInst * alloca = tmp.CreateAlloca(Type::getInt32Ty(mContext),
+                                           0, it.first.c_str());
+    tmp.CreateStore(gvar->getInitializer(), alloca);
+    s.val = alloca;
+    gvar->eraseFromParent();
+  }
+}
+
 const SymbolTable::Symbol & SymbolTable::get(const string & ident) {
   assert ( exists(ident) );
   /* local */
@@ -143,12 +180,18 @@ const SymbolTable::Symbol & SymbolTable::get(const string & ident) {
     auto it = mLocals.find(ident);
     if ( it != mLocals.end() ) return *(it->second);
   }
+  return getGlobal(ident);
+}
+
+const SymbolTable::Symbol & SymbolTable::getGlobal(const string & ident) {
+  assert ( existsGlobal(ident) || existsForward(ident) );
   /* forward */
   auto it = mForward.find(ident);
   if ( it != mForward.end() ) return *(it->second);
 
   /* global */
   auto & res = mTable.find(ident)->second;
+  if ( mLocalScope && mFIdent != "main" ) mCallableRefs.insert(ident);
   return *res;
 }
 
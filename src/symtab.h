@@ -2,6 +2,7 @@
 #define SYMTAB
 
 #include <map>
+#include <set>
 #include <string>
 #include <memory>
 
@@ -49,6 +50,7 @@ public:
   string getFIdent();
 
   const Symbol & get(const string & ident); // does not check whether exists
+  const Symbol & getGlobal(const string & ident); // skips the locals
   bool exists(const string & ident) const;
   bool existsGlobal(const string & ident) const;
   bool existsLocal(const string & ident) const;
@@ -63,6 +65,10 @@ public:
   void declVar(string ident, Object * o, bool first); // todo: this could return the stored Symbol
   void declCallable(bool forward, string ident, CallableObj * o, Function * f);
 
+  /* turns global integer variables that no callable refers to into locals
+   * of the current function (main), so that they can live in registers */
+  void localizeGlobals();
+
   void ensureDeclared(const string & ident) const;
   void ensureNotDeclared(const string & ident) const;
   void ensureNotDeclaredForward(const string & ident) const;
@@ -80,6 +86,7 @@ private:
   Table mTable; // globals
   Table mLocals;
   Table mForward; // forward (callable) declarations
+  set<string> mCallableRefs; // globals referenced from callables other than main
   Function * mFunction;
   string mFIdent;
   bool mLocalScope;
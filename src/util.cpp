@@ -10,6 +10,20 @@ void util_init(Input * input)
   mInput = input;
 }
 
+int util_lineNumber()
+{
+  return mInput ? mInput->curLineNumber() : 0;
+}
+
+string util_cacheDir()
+{
+  if ( const char * xdg = getenv("XDG_CACHE_HOME") )
+    return string(xdg) + "/mila";
+  if ( const char * home = getenv("HOME") )
+    return string(home) + "/.cache/mila";
+  return "";
+}
+
 void error(const string & text, bool printLine)
 {
   cout << "Error";
@@ -21,3 +35,8 @@ void error(const string & text, bool printLine)
   cout << mInput->curLine() << endl;
   exit(1);
 }
+
+void warning(const string & text)
+{
+  cout << "Warning: " << text << endl;
+}
@@ -8,6 +8,9 @@
 using namespace std;
 
 void util_init(Input * input);
+int util_lineNumber(); // line of the input being read
+string util_cacheDir(); // $XDG_CACHE_HOME/mila or ~/.cache/mila, "" if none
 void error(const string & text, bool printLine = true);
+void warning(const string & text);
 
 #endif // UTIL_H
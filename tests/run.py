@@ -1,6 +1,7 @@
 #!/usr/bin/python3
 
-import sys, glob, os, shutil, subprocess
+import sys, glob, os, re, shutil, subprocess
+from multiprocessing import Pool
 
 memcheck = False
 
@@ -24,13 +25,57 @@ def fetch_subinput_impl(fin, out):
       return False
     print(line, file=fout, end='')
 
-def fetch_subinput(fin):
-  return fetch_subinput_impl(fin, "tmp2")
-
-def fetch_input(fprog):
-  return fetch_input_impl(fprog, "tmp")
-
-def produce_output(fprog, fout, first, fin):
+# every program has its own work files, so that programs can be tested in
+# parallel
+def fetch_subinput(fin, work):
+  return fetch_subinput_impl(fin, work + ".in")
+
+def fetch_input(fprog, work):
+  return fetch_input_impl(fprog, work + ".mila")
+
+# options of a test are { key: value } comments at the top of the program:
+#   flags: <flags>       - compiler flags
+#   diagnostics: yes     - the output starts with what the compiler printed
+#   runtime-errors: yes  - the output has the error output of the program and
+#                          its exit status
+#   mask: <regex>        - what the regex matches in the output is replaced
+#                          by *, for details that may change (sizes, costs)
+#   variant-of: <test>   - the program and input of another test, compiled
+#                          with the flags of this one as well; the output must
+#                          be the golden output of the other test
+#   check: <command>     - a command run after the program, its output is
+#                          appended (to check the files the compiler wrote)
+# @TMP@ in the flags and the check is a directory of the test, it is kept
+# across the inputs and removed at the end
+def read_options(prog):
+  options = {}
+  with open(prog, "r") as f:
+    for line in f:
+      m = re.match(r"\{ *([a-z-]+): *(.*?) *\}$", line.strip())
+      if not m:
+        break
+      options[m.group(1)] = m.group(2)
+  return options
+
+def name(prog):
+  return prog[prog.find("/")+1:-5]
+
+# the program file of a test and its options
+def source(prog):
+  options = read_options(prog)
+  if "variant-of" not in options:
+    return prog, options
+  base = "program/" + options["variant-of"] + ".mila"
+  base_options = read_options(base)
+  flags = base_options.get("flags", "") + " " + options.get("flags", "")
+  base_options.update(options)
+  base_options["flags"] = flags.strip()
+  return base, base_options
+
+def golden_name(program):
+  return name(source("program/" + program + ".mila")[0])
+
+def produce_output(fprog, fout, first, fin, exe, options):
   mila = "../llvm-obj/Debug+Asserts/examples/Mila"
   if not os.path.exists(mila):
     mila = "../llvm-obj/Release+Asserts/examples/Mila"
@@ -44,16 +89,30 @@ def produce_output(fprog, fout, first, fin):
     print("---output---", file=f)
     f.close()
 
+  compile = mila + " " + options.get("flags", "") + " " + fprog + " -o " + exe
+  compiler_output = " 1>/dev/null 2>&1"
+  if options.get("diagnostics") == "yes":
+    compiler_output = " 1>>" + fout + " 2>&1"
   if memcheck:
     valgrind = "valgrind --tool=memcheck --leak-check=yes "
-    code = os.system(valgrind + mila + " " + fprog)
+    code = os.system(valgrind + compile)
   else:
-    code = os.system(mila + " " + fprog + " 1>/dev/null 2>&1")
+    code = os.system(compile + compiler_output)
   if code == 0:
+    run = "./" + exe
     if os.path.isfile(fin):
-        os.system("./a.out < " + fin + " >> " + fout)
-    else:
-        os.system("./a.out >> " + fout)
+        run += " < " + fin
+    run += " >> " + fout
+    errors = options.get("runtime-errors") == "yes"
+    if errors:
+      run += " 2>&1"
+    status = os.system(run)
+    if errors:
+      f = open(fout, "a")
+      print(str(status >> 8), file=f)
+      f.close()
+  if "check" in options:
+    os.system(options["check"] + " >> " + fout + " 2>&1")
 
   f = open(fout, "a")
   print(str(code), file=f)
@@ -61,32 +120,57 @@ def produce_output(fprog, fout, first, fin):
 
 def gen_input(folder, prog):
   print("processing " + prog)
-  program = prog[prog.find("/")+1:-5]
+  program = name(prog)
+  prog, options = source(prog)
   fprog = open(prog, "r")
 
-  finstr = "input/" + program + ".txt"
+  finstr = "input/" + name(prog) + ".txt"
   fin = 0
   if os.path.isfile(finstr):
     fin = open(finstr, "r")
 
+  work = "tmp." + program
+  out = folder + "/" + program + ".txt"
+  tmp = work + ".d"
+  if os.path.isdir(tmp):
+    shutil.rmtree(tmp)
+  os.mkdir(tmp)
+  for key in ["flags", "check"]:
+    if key in options:
+      options[key] = options[key].replace("@TMP@", tmp)
   first = True
   if fin == 0: # no inputs
-    while fetch_input(fprog):
-      produce_output("tmp", folder + "/" + program + ".txt", first, "tmp2")
+    while fetch_input(fprog, work):
+      produce_output(work + ".mila", out, first, work + ".in", work, options)
       first = False
-    produce_output("tmp", folder + "/" + program + ".txt", first, "tmp2")
+    produce_output(work + ".mila", out, first, work + ".in", work, options)
   else:
     while True:
-      ret = fetch_input(fprog)
+      ret = fetch_input(fprog, work)
       while True:
-        ret2 = fetch_subinput(fin)
-        produce_output("tmp", folder + "/" + program + ".txt", first, "tmp2")
+        ret2 = fetch_subinput(fin, work)
+        produce_output(work + ".mila", out, first, work + ".in", work,
+                       options)
         first = False
         if ret2 == False:
           break
       if ret == False:
         break
 
+  for f in [work, work + ".mila", work + ".in"]:
+    if os.path.isfile(f):
+      os.remove(f)
+  shutil.rmtree(tmp)
+
+  if "mask" in options and os.path.isfile(out):
+    with open(out, "r") as f:
+      text = f.read()
+    with open(out, "w") as f:
+      f.write(re.sub(options["mask"], "*", text))
+
+def gen_input_args(args):
+  gen_input(*args)
+
 def gen(folder, input):
   if input == "--all":
     if os.path.isdir(folder):
@@ -96,16 +180,22 @@ def gen(folder, input):
     if os.path.isfile(folder + "/" + input + ".txt"):
       os.remove(folder + "/" + input + ".txt")
 
+  # variants have the golden output of the test they are a variant of
   if input == "--all":
-    for file in glob.glob("program/*.mila"):
-      gen_input(folder, file)
+    programs = [(folder, f) for f in glob.glob("program/*.mila")
+                if folder != "golden" or golden_name(name(f)) == name(f)]
+    with Pool() as pool:
+      pool.map(gen_input_args, programs)
+  elif folder == "golden" and golden_name(input) != input:
+    print(input + " is a variant of " + golden_name(input))
   else:
       gen_input(folder, "program/" + input + ".mila")
 
 def test():
   gen("output", "--all")
   for file in glob.glob("output/*.txt"):
-    code = os.system("diff golden/" + file[7:] + " " + file + " > tmp")
+    golden = "golden/" + golden_name(file[7:-4]) + ".txt"
+    code = os.system("diff " + golden + " " + file + " > tmp")
     if code != 0:
       print("difference in " + file + " found")
       with open("tmp", "r") as f: